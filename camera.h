@@ -2,50 +2,293 @@
 #define CAMERA_H
 
 #include <opencv2/videoio.hpp>
+#include <opencv2/imgproc.hpp>
 #include <opencv2/core.hpp>
 #include <iostream>
 
+#include "colorConversion.h"
 #include "layer.h"
 
 class Camera{
 private:
 	cv::VideoCapture cap;
 	cv::Mat rawFrame;
+	cv::Mat convertedFrame;
 
 	Layer frame;
 
-	int deviceID;
+	int deviceID = -1;
 	int apiID;
+	bool opened = false;
+
+	//Raw YUV capture, converted and scaled in one pass
+	bool rawCapture = false;
+	YUVFormat rawFormat = YUV_YUYV;
+	cv::Size frameSize;
+
+	//Size at open, which all scaling is relative to, and the last negotiated request
+	cv::Size nominalSize;
+	cv::Size requestedSize;
+	int requestedFPS = 0;
 public:
 	Camera() {}
 	Camera(int did){
 		deviceID = did;
 		apiID = cv::CAP_ANY;
 
-		cap.open(deviceID, apiID);
+		//A negative device ID runs without a camera
+		if(deviceID >= 0){
+			cap.open(deviceID, apiID);
+			opened = cap.isOpened();
+		}
 
-		if(!cap.isOpened()){
-			printf("Error: Unable to open camera %d\n", deviceID);
+		if(opened){
+			//Keep only the newest frame queued
+			cap.set(cv::CAP_PROP_BUFFERSIZE, 1);
+			cap.read(rawFrame);
+		}
+		else{
+			printf("Error: Unable to open camera %d, using test pattern\n", deviceID);
+			rawFrame = getTestPattern();
 		}
 
+		frameSize = rawFrame.size();
+		nominalSize = frameSize;
+		requestedSize = frameSize;
+		frame = Layer(rawFrame);
+	}
+
+	//Read and return next frame, scaled to [dstSize] if given, otherwise the nominal size.
+	//If [region] is given, only that part of the scaled frame is converted
+	Layer readFrame(cv::Size dstSize=cv::Size(), cv::Rect region=cv::Rect()){
+		if(opened){
+			cap.read(rawFrame);
+		}
+		frame.setTimestamp(getCaptureTime());
+		if(dstSize.width <= 0 || dstSize.height <= 0){
+			dstSize = nominalSize;
+		}
+		region &= cv::Rect(0, 0, dstSize.width, dstSize.height);
+		if(region.area() == 0){
+			region = cv::Rect(0, 0, dstSize.width, dstSize.height);
+		}
+		bool full = region.size() == dstSize;
+
+		//Raw capture: convert and scale in a single pass, keeping the last frame if the read failed
+		if(rawCapture){
+			if(isRawFrameValid()){
+				convertYUV(rawFrame, rawFormat, frameSize, convertedFrame, dstSize, region);
+				frame.setImage(convertedFrame);
+				frame.setOpaque(true);
+			}
+		}
+		//BGR capture: scale before adding the alpha channel
+		else if(rawFrame.empty()){
+			return frame;
+		}
+		else if(full && dstSize == rawFrame.size()){
+			frame.setImage(rawFrame);
+		}
+		else{
+			scaleRegion(rawFrame, convertedFrame, dstSize, region);
+			frame.setImage(convertedFrame);
+		}
+		if(!full){
+			frame.setRegion(region.tl(), dstSize);
+		}
+		return frame;
+	}
+
+	//Nearest-neighbour scale of the [region] of [src] scaled to [dstSize], mapped the same way as convertYUV
+	static void scaleRegion(const cv::Mat &src, cv::Mat &dst, cv::Size dstSize, cv::Rect region){
+		std::vector<int> xmap, ymap;
+		getScaleMap(xmap, region.x, region.width, src.cols, dstSize.width);
+		getScaleMap(ymap, region.y, region.height, src.rows, dstSize.height);
+		dst.create(region.size(), src.type());
+		size_t pixelSize = src.elemSize();
+
+		cv::parallel_for_(cv::Range(0, region.height), [&](const cv::Range &range){
+			for(int y = range.start; y < range.end; y++){
+				const uchar *row = src.ptr(ymap[y]);
+				uchar *out = dst.ptr(y);
+				for(int x = 0; x < region.width; x++){
+					memcpy(out + x * pixelSize, row + xmap[x] * pixelSize, pixelSize);
+				}
+			}
+		});
+	}
+
+	//Capture time of the last frame, from the V4L2 buffer timestamp if plausible, otherwise now
+	Timestamp getCaptureTime(){
+		Timestamp now = getMonotonicTime();
+		if(opened){
+			double ms = cap.get(cv::CAP_PROP_POS_MSEC);
+			Timestamp buffer(std::chrono::duration_cast<Timestamp::duration>(std::chrono::duration<double, std::milli>(ms)));
+			double age = getMilliseconds(buffer, now);
+			if(ms > 0 && age >= 0 && age < 1000){
+				return buffer;
+			}
+		}
+		return now;
+	}
+
+	//Read and return next frame, scaled by [scale] relative to the nominal size
+	Layer readFrame(float scale){
+		return readFrame(getScaledSize(scale));
+	}
+
+	//Configure the smallest capture mode covering [target] with the nominal aspect ratio, at [fps] if above 0
+	void negotiate(cv::Size target, int fps){
+		//Common UVC modes, smallest first
+		static const cv::Size modes[] = {
+			cv::Size(160, 120), cv::Size(176, 144), cv::Size(320, 180), cv::Size(320, 240), cv::Size(352, 288),
+			cv::Size(424, 240), cv::Size(612, 460), cv::Size(640, 360), cv::Size(640, 480), cv::Size(800, 448),
+			cv::Size(800, 600), cv::Size(848, 480), cv::Size(960, 540), cv::Size(1024, 576), cv::Size(1280, 720),
+			cv::Size(1280, 960), cv::Size(1600, 896), cv::Size(1600, 1200), cv::Size(1920, 1080)
+		};
+
+		if(!opened || (target == requestedSize && fps == requestedFPS)){
+			return;
+		}
+		requestedSize = target;
+		requestedFPS = fps;
+
+		if(fps > 0){
+			cap.set(cv::CAP_PROP_FPS, fps);
+		}
+
+		//Try modes covering the target until the driver accepts one, otherwise return to the nominal size
+		bool found = false;
+		for(const cv::Size &mode : modes){
+			if(mode.width >= target.width && mode.height >= target.height && hasNominalAspect(mode)){
+				cv::Size actual = setMode(mode);
+				if(actual.width >= target.width && actual.height >= target.height && hasNominalAspect(actual)){
+					found = true;
+					break;
+				}
+			}
+		}
+		if(!found){
+			setMode(nominalSize);
+		}
+		cap.set(cv::CAP_PROP_BUFFERSIZE, 1);
+
+		//Refresh frame size from a new frame
 		cap.read(rawFrame);
+		if(!rawCapture || !isRawFrameValid()){
+			frameSize = rawFrame.size();
+		}
+		printf("Camera negotiated %d X %d at %d fps for target %d X %d\n",
+			frameSize.width, frameSize.height, (int)cap.get(cv::CAP_PROP_FPS), target.width, target.height);
+	}
 
-		frame = Layer(rawFrame);
+	//Set capture resolution, returning the resolution the driver chose
+	cv::Size setMode(cv::Size mode){
+		cap.set(cv::CAP_PROP_FRAME_WIDTH, mode.width);
+		cap.set(cv::CAP_PROP_FRAME_HEIGHT, mode.height);
+		return cv::Size((int)cap.get(cv::CAP_PROP_FRAME_WIDTH), (int)cap.get(cv::CAP_PROP_FRAME_HEIGHT));
+	}
+
+	//Returns whether [size] matches the nominal aspect ratio within 1%
+	bool hasNominalAspect(cv::Size size){
+		float nominal = (float)nominalSize.width / nominalSize.height;
+		float aspect = (float)size.width / size.height;
+		return std::abs(aspect - nominal) <= nominal * 0.01;
+	}
+
+	//Size of a frame scaled by [scale] relative to the nominal size
+	cv::Size getScaledSize(float scale){
+		return cv::Size(cvRound(nominalSize.width * scale), cvRound(nominalSize.height * scale));
 	}
 
-	//Read and return next frame
-	Layer readFrame(){
+	//Request raw YUYV frames instead of BGR
+	void setRawCapture(bool raw){
+		if(!opened){
+			printf("Error: No camera open\n");
+			return;
+		}
+		if(raw){
+			cap.set(cv::CAP_PROP_FOURCC, cv::VideoWriter::fourcc('Y', 'U', 'Y', 'V'));
+			cap.set(cv::CAP_PROP_CONVERT_RGB, 0);
+		}
+		else{
+			cap.set(cv::CAP_PROP_CONVERT_RGB, 1);
+		}
+		rawCapture = raw;
 		cap.read(rawFrame);
-		frame.setImage(rawFrame);
-		return frame;
+
+		//Fall back to BGR if the device doesn't deliver a supported raw format
+		if(raw && !isRawFrameValid()){
+			printf("Error: Camera did not provide YUYV or NV12 frames, using BGR\n");
+			cap.set(cv::CAP_PROP_CONVERT_RGB, 1);
+			rawCapture = false;
+			cap.read(rawFrame);
+		}
+		if(!rawCapture){
+			frameSize = rawFrame.size();
+		}
+		printf("Camera capture format: %s\n", rawCapture ? (rawFormat == YUV_YUYV ? "YUYV" : "NV12") : "BGR");
+	}
+
+	//Returns whether the last raw frame is YUYV or NV12, setting the frame size
+	bool isRawFrameValid(){
+		int width = (int)cap.get(cv::CAP_PROP_FRAME_WIDTH);
+		int height = (int)cap.get(cv::CAP_PROP_FRAME_HEIGHT);
+		if(rawFrame.type() == CV_8UC2 && rawFrame.cols == width && rawFrame.rows == height){
+			rawFormat = YUV_YUYV;
+		}
+		else if(rawFrame.type() == CV_8UC1 && rawFrame.cols == width && rawFrame.rows == height * 3 / 2){
+			rawFormat = YUV_NV12;
+		}
+		else{
+			return false;
+		}
+		frameSize = cv::Size(width, height);
+		return true;
+	}
+
+	//Deterministic color bars, used in place of an unavailable camera
+	static cv::Mat getTestPattern(){
+		const cv::Vec3b bars[8] = {
+			cv::Vec3b(255, 255, 255), cv::Vec3b(0, 255, 255), cv::Vec3b(255, 255, 0), cv::Vec3b(0, 255, 0),
+			cv::Vec3b(255, 0, 255), cv::Vec3b(0, 0, 255), cv::Vec3b(255, 0, 0), cv::Vec3b(0, 0, 0)
+		};
+		cv::Mat pattern(480, 640, CV_8UC3);
+		for(int y = 0; y < pattern.rows; y++){
+			for(int x = 0; x < pattern.cols; x++){
+				pattern.at<cv::Vec3b>(y, x) = bars[x * 8 / pattern.cols];
+			}
+		}
+		return pattern;
+	}
+
+	bool isOpened(){
+		return opened;
+	}
+	bool isRawCapture(){
+		return rawCapture;
+	}
+	cv::Size getFrameSize(){
+		return frameSize;
+	}
+	cv::Size getNominalSize(){
+		return nominalSize;
+	}
+	int getRequestedFPS(){
+		return requestedFPS;
 	}
 
 	//Print camera and frame properties
 	void printInfo(){
 		readFrame();
+		if(!opened){
+			printf("Capture Device: test pattern\n");
+			return;
+		}
 
 		printf("Capture Device API: %s\n", cap.getBackendName().c_str());
-		printf("Capture Device Format ID: %d\n", cap.get(cv::CAP_PROP_FORMAT));
+		printf("Capture Device Format ID: %d\n", (int)cap.get(cv::CAP_PROP_FORMAT));
+		printf("Capture Mode: %s\n", rawCapture ? (rawFormat == YUV_YUYV ? "YUYV" : "NV12") : "BGR");
 		printf("Frame Width X Height (Raw, Processed): %d X %d, %d X %d\n", 
 			rawFrame.cols, rawFrame.rows, frame.getImage().cols, frame.getImage().rows);
 		printf("Frame Channels (Raw, Processed): %d, %d\n", rawFrame.channels(), frame.getImage().channels());
@@ -54,7 +297,9 @@ public:
 
 	//Release camera
 	void closeCamera(){
-		cap.release();
+		if(opened){
+			cap.release();
+		}
 	}
 };
 
@@ -3,46 +3,69 @@
 
 #include <opencv2/core.hpp>
 #include <bitset>
+#include <memory>
+#include <string>
+#include <mutex>
+#include <map>
 
 #include "imageManager.h"
+#include "sharedFrames.h"
+#include "recorder.h"
 #include "framebuffer.h"
+#include "headless.h"
+#include "output.h"
 #include "camera.h"
+#include "display.h"
+#include "latency.h"
 #include "layer.h"
 #include "text.h"
 #include "helper.h"
 
 #define MONITOR_SCALE 0.5
+#define COMPOSITE_XRES 1080 //One Vive eye
+#define COMPOSITE_YRES 1200
 
 class Canvas{
 private:
-	Framebuffer fb_vive;
-	Framebuffer fb_monitor;
+	std::vector<Display*> displays;
 	ImageManager images;
 	Camera camera;
 	Text text;
 
-	int vive_xres, vive_xres_eye, vive_yres;
-	int mon_xres, mon_yres;
-
-	bool monitor, vive;
 	Layer blankScreen;
 	Text::Styling textStyling;
+	LatencyMonitor latency;
+	double viveRate = 60;
+	SharedFrameWriter exporter;
+	Recorder recorder;
+
+	//Shared memory Layer sources, opened on first use and reopened when their writer restarts
+	std::map<std::string, std::shared_ptr<SharedFrameReader>> sharedSources;
+	std::map<std::string, Timestamp> sharedRetry;
+	std::mutex sharedMut;
 
 public:
-	//Constructor
-	Canvas(std::string dev_dir_vive, std::string dev_dir_mon, int cam_dev, std::string imagePath, std::string textPath, bool m, bool v){
-		//Initialize Framebuffers
-		fb_vive = Framebuffer(dev_dir_vive.c_str());
-		vive_xres = fb_vive.getVarInfo().xres;
-		vive_xres_eye = vive_xres / 2;
-		vive_yres = fb_vive.getVarInfo().yres;
-
-		fb_monitor = Framebuffer(dev_dir_mon.c_str());
-		mon_xres = fb_monitor.getVarInfo().xres;
-		mon_yres = fb_monitor.getVarInfo().yres;
+	//Constructor, drawing to framebuffer devices
+	Canvas(std::string dev_dir_vive, std::string dev_dir_mon, int cam_dev, std::string imagePath, std::string textPath, bool m, bool v) :
+		Canvas(new Framebuffer(dev_dir_vive.c_str()), new Framebuffer(dev_dir_mon.c_str()), cam_dev, imagePath, textPath, m, v) {}
+
+	//Constructor, drawing to any Output. Canvas takes ownership of the outputs
+	Canvas(Output *vive_output, Output *mon_output, int cam_dev, std::string imagePath, std::string textPath, bool m, bool v){
+		//Initialize BlankScreen
+		blankScreen = Layer(cv::Size(COMPOSITE_XRES, COMPOSITE_YRES), cv::Vec4b(0, 0, 0, 255));
+
+		//Initialize Displays, the Vive shows one copy per eye, the monitor a right-aligned preview
+		DisplaySettings viveSettings;
+		viveSettings.copies = 2;
+		addDisplay("vive", vive_output, viveSettings, &latency);
+
+		DisplaySettings monitorSettings;
+		monitorSettings.scale = MONITOR_SCALE;
+		monitorSettings.alignRight = true;
+		addDisplay("monitor", mon_output, monitorSettings);
 
 		//Initialize ImageManager
-		images = ImageManager(imagePath);
+		images.load(imagePath);
 
 		//Initialize Camera
 		camera = Camera(cam_dev);
@@ -55,83 +78,266 @@ public:
 		textStyling.fontSize = 3;
 		text.setStyling(textStyling);
 
-		//Initialize BlankScreen, set default display outputs
-		blankScreen = Layer(cv::Size(1080, 1200), cv::Vec4b(0, 0, 0, 255));
+		//Set default display outputs
 		setOutput(m, v);
 	}
 
-	//Draw to framebuffer
-	void draw(Layer l){
-		draw(l, monitor, vive);
+	//Add a Display showing the composite, Canvas takes ownership of the output
+	void addDisplay(std::string name, Output *output, DisplaySettings settings, LatencyMonitor *l=0){
+		displays.push_back(new Display(name, output, settings, l));
 	}
 
-	void draw(Layer l_raw, bool drawMonitor, bool drawVive){
+	//Draw to every enabled Display
+	void draw(Layer l_raw){
 		//Overlay layer onto BlankScreen
 		Layer l = blankScreen.copy();
 		l.overlay(l_raw);
 
+		//Every Display shares the composite, each presenting it at its own rate
 		cv::Mat m = l.getImage();
-		int rowSize;
-
-		//Draw on Vive framebuffer
-		if(drawVive){
-			rowSize = sizeof(cv::Vec4b) * m.cols;
-			for(int i = 0; i < m.rows; i++){
-				fb_vive.putRow(m.ptr(i), 0, i, rowSize);
-				fb_vive.putRow(m.ptr(i), 1080, i, rowSize);
-			}
+		for(Display *d : displays){
+			d->show(m, l_raw.getTimestamp());
+		}
+
+		//Publish for other processes, and record
+		if(exporter.isOpen()){
+			exporter.publish(m, SHARED_FORMAT_BGRA, l_raw.getTimestamp());
+		}
+		recorder.submit(m, l_raw.getTimestamp());
+	}
+
+	//Record every composite to [filename], or stop recording if empty
+	void setRecording(std::string filename){
+		if(filename == ""){
+			recorder.stop();
+		}
+		else{
+			recorder.start(filename);
 		}
-		//Rescale and draw on Monitor framebuffer
-		if(drawMonitor){
-			resize(m, m, cv::Size(), MONITOR_SCALE, MONITOR_SCALE, cv::INTER_NEAREST);
-			int mon_x_offset = mon_xres - m.cols;
+	}
 
-			rowSize = sizeof(cv::Vec4b) * m.cols;
-			for(int i = 0; i < m.rows; i++){
-				fb_monitor.putRow(m.ptr(i), mon_x_offset, i, rowSize);
+	//Publish every composite to shared memory [name], or stop if empty
+	void setExport(std::string name){
+		if(name == ""){
+			if(exporter.isOpen()){
+				printf("Stopped publishing frames to %s after %lu frames\n", exporter.getName().c_str(), (unsigned long)exporter.getFrameNumber());
 			}
+			exporter.close();
+			return;
 		}
+		exporter.open(name, cv::Size(COMPOSITE_XRES, COMPOSITE_YRES));
 	}
 
-	//Fill framebuffers with black
-	void clear(bool monitor=true, bool vive=true){
-		draw(blankScreen, monitor, vive);
+	//Present the Vive on its own thread at the display rate, reprojecting reused frames
+	void setTimewarp(bool t){
+		Display *vive = getDisplay("vive");
+		vive->setReprojection(t);
+		vive->setRate(t ? viveRate : 0);
+		if(t){
+			printf("Timewarp enabled at %.0f Hz\n", viveRate);
+		}
+		else{
+			printf("Timewarp disabled\n");
+		}
 	}
 
-	//Set display outputs
-	void setMonitorOutput(bool m){ setOutput(m, vive); }
-	void setViveOutput(bool v){ setOutput(monitor, v); }
+	//Set the Vive display rate used by the presenter
+	void setTimewarpRate(double rate){
+		if(rate <= 0){
+			displayInvalidMessage("Rate must be positive");
+			return;
+		}
+		viveRate = rate;
+		if(getDisplay("vive")->getRate() > 0){
+			setTimewarp(true);
+		}
+	}
+
+	//Replay orientation from [filename] for reprojection, or hold still if empty
+	void setOrientationReplay(std::string filename){
+		if(filename == ""){
+			getDisplay("vive")->setOrientationSource(std::make_shared<FixedOrientationSource>());
+		}
+		else{
+			getDisplay("vive")->setOrientationSource(std::make_shared<ReplayOrientationSource>(filename));
+		}
+	}
 
+	//Fill every Display with black
+	void clear(){
+		for(Display *d : displays){
+			d->write(blankScreen.getImage(), Timestamp());
+		}
+	}
+
+	//Set display outputs
 	void setOutput(bool m, bool v){
-		monitor = m;
-		vive = v;
-		if(!m){
-			draw(blankScreen, true, false);
+		setDisplayEnabled("monitor", m);
+		setDisplayEnabled("vive", v);
+	}
+
+	//Enable or disable Display [name], returns false if it doesn't exist
+	bool setDisplayEnabled(std::string name, bool enabled){
+		Display *d = getDisplay(name);
+		if(d == 0){
+			return false;
 		}
-		if(!v){
-			draw(blankScreen, false, true);
+		d->setEnabled(enabled, blankScreen.getImage());
+		return true;
+	}
+
+	//Returns the Display named [name], 0 if not found
+	Display *getDisplay(std::string name){
+		for(Display *d : displays){
+			if(d->getName() == name){
+				return d;
+			}
 		}
+		return 0;
+	}
+
+	void printDisplays(){
+		for(Display *d : displays){
+			d->printInfo();
+		}
+	}
+
+	//Camera settings
+	void setCameraRawCapture(bool raw){
+		camera.setRawCapture(raw);
+	}
+	void printCameraInfo(){
+		camera.printInfo();
+	}
+	void negotiateCamera(cv::Size target, int fps){
+		camera.negotiate(target, fps);
+	}
+	cv::Size getCameraNominalSize(){
+		return camera.getNominalSize();
+	}
+	cv::Size getCameraScaledSize(float scale){
+		return camera.getScaledSize(scale);
+	}
+	int getCameraFPS(){
+		return camera.getRequestedFPS();
 	}
 
 	//Get methods
 	Layer getImageFrame(std::string name){
 		return images.getImage(name);
 	}
+	Layer getImageFrame(std::string name, cv::Size minSize){
+		return images.getImage(name, minSize);
+	}
+	cv::Size getImageSize(std::string name, cv::Size minSize=cv::Size()){
+		return images.getLevelSize(name, minSize);
+	}
+	cv::Size getCompositeSize(){
+		return cv::Size(COMPOSITE_XRES, COMPOSITE_YRES);
+	}
 	Layer getCameraFrame(){
 		return camera.readFrame();
 	}
-	ImageManager getImageManager(){
+	Layer getCameraFrame(cv::Size size, cv::Rect region=cv::Rect()){
+		return camera.readFrame(size, region);
+	}
+	Layer getCameraFrame(float scale){
+		return camera.readFrame(scale);
+	}
+
+	//Newest frame in shared memory [name], only [region] of it if given. Pixels are copied or converted out of the
+	//shared memory, so no Layer points into a mapping that is closed when the writer restarts
+	Layer getSharedFrame(std::string name, cv::Rect region=cv::Rect()){
+		std::shared_ptr<SharedFrameReader> source = getSharedSource(name);
+		SharedFrame frame;
+		cv::Rect full;
+		cv::Mat pixels;
+
+		//Read again if the writer came back around the ring to the frame while it was copied
+		for(int attempt = 0; ; attempt++){
+			if(!source || attempt == SHARED_FRAME_SLOTS || !source->getLatest(&frame)){
+				return Layer();
+			}
+			full = cv::Rect(cv::Point(), frame.size);
+			cv::Rect visible = region.area() > 0 ? region & full : full;
+			if(frame.format == SHARED_FORMAT_BGRA){
+				frame.image(visible).copyTo(pixels);
+			}
+			else{
+				convertYUV(frame.image, frame.format == SHARED_FORMAT_YUYV ? YUV_YUYV : YUV_NV12, frame.size, pixels, frame.size, visible);
+			}
+			if(source->isUnchanged(frame)){
+				region = visible;
+				break;
+			}
+		}
+		Layer result(pixels);
+		result.setOpaque(frame.format != SHARED_FORMAT_BGRA || (frame.flags & SHARED_FLAG_OPAQUE));
+		if(region != full){
+			result.setRegion(region.tl(), frame.size);
+		}
+		result.setTimestamp(frame.captured);
+		return result;
+	}
+	cv::Size getSharedFrameSize(std::string name){
+		std::shared_ptr<SharedFrameReader> source = getSharedSource(name);
+		SharedFrame frame;
+		if(!source || !source->getLatest(&frame)){
+			return cv::Size();
+		}
+		return frame.size;
+	}
+	LatencyMonitor *getLatencyMonitor(){
+		return &latency;
+	}
+	ImageManager &getImageManager(){
 		return images;
 	}
-	Text getText(){
+	Text &getText(){
 		return text;
 	}
 
+	//Touch every page of the outputs, so the first frames after locking memory don't page fault
+	void prefault(){
+		for(Display *d : displays){
+			d->prefault();
+		}
+	}
+
+private:
+	//Returns the reader of shared memory [name], trying to open it at most once a second until its writer is running
+	std::shared_ptr<SharedFrameReader> getSharedSource(std::string name){
+		std::lock_guard<std::mutex> lock(sharedMut);
+		std::shared_ptr<SharedFrameReader> &source = sharedSources[name];
+		if(source && source->isWriterAlive()){
+			return source;
+		}
+		Timestamp now = getMonotonicTime();
+		std::map<std::string, Timestamp>::iterator retry = sharedRetry.find(name);
+		if(retry != sharedRetry.end() && now < retry->second){
+			return source;
+		}
+
+		//Errors are only printed on the first attempt, a stopped writer keeps its last frame until it restarts
+		std::shared_ptr<SharedFrameReader> reader = std::make_shared<SharedFrameReader>();
+		if(reader->open(name, retry == sharedRetry.end())){
+			source = reader;
+		}
+		sharedRetry[name] = now + std::chrono::seconds(1);
+		return source;
+	}
+
+public:
 	//Always run on exit
 	void closeAll(){
 		camera.closeCamera();
-		fb_vive.closeFramebuffer();
-		fb_monitor.closeFramebuffer();
+		recorder.stop();
+		exporter.close();
+		sharedSources.clear();
+		for(Display *d : displays){
+			delete d;
+		}
+		displays.clear();
 	}
 };
 
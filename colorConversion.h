@@ -0,0 +1,101 @@
+#ifndef COLORCONVERSION_H
+#define COLORCONVERSION_H
+
+#include <opencv2/core.hpp>
+#include <vector>
+
+//Raw camera formats understood by convertYUV
+enum YUVFormat{
+	YUV_YUYV, //Packed 4:2:2, CV_8UC2
+	YUV_NV12  //Planar Y, interleaved UV 4:2:0, CV_8UC1 with 3/2 the rows
+};
+
+//Fixed-point BT.601 tables, built once
+struct YUVTables{
+	int y[256];
+	int rv[256];
+	int gu[256];
+	int gv[256];
+	int bu[256];
+	uchar clip[1024];
+
+	YUVTables(){
+		for(int i = 0; i < 256; i++){
+			y[i] = 298 * (i - 16) + 128 + (384 << 8);
+			rv[i] = 409 * (i - 128);
+			gu[i] = -100 * (i - 128);
+			gv[i] = -208 * (i - 128);
+			bu[i] = 516 * (i - 128);
+		}
+		//Clip table is offset by 384, covering the full range of the sums above
+		for(int i = 0; i < 1024; i++){
+			clip[i] = (uchar)std::max(0, std::min(i - 384, 255));
+		}
+	}
+};
+
+static const YUVTables &getYUVTables(){
+	static const YUVTables tables;
+	return tables;
+}
+
+//Write one BGRA pixel from Y, U and V
+static inline void putYUVPixel(const YUVTables &t, uchar *dst, int y, int u, int v){
+	int luma = t.y[y];
+	dst[0] = t.clip[(luma + t.bu[u]) >> 8];
+	dst[1] = t.clip[(luma + t.gu[u] + t.gv[v]) >> 8];
+	dst[2] = t.clip[(luma + t.rv[v]) >> 8];
+	dst[3] = 255;
+}
+
+//Source index for each of [count] destination indices from [offset], scaling [srcLength] to [dstLength]
+//Computed from the full-frame geometry, so a region maps to the same source pixels as the whole frame would
+static inline void getScaleMap(std::vector<int> &map, int offset, int count, int srcLength, int dstLength){
+	map.resize(count);
+	for(int i = 0; i < count; i++){
+		map[i] = (int)((int64_t)(offset + i) * srcLength / dstLength);
+	}
+}
+
+//Convert the [region] of a raw YUV frame scaled to [dstSize] to BGRA, in a single nearest-neighbour pass
+//[frameSize] is the size of the image, which for NV12 differs from the size of the raw buffer
+void convertYUV(const cv::Mat &src, YUVFormat format, cv::Size frameSize, cv::Mat &dst, cv::Size dstSize, cv::Rect region){
+	const YUVTables &t = getYUVTables();
+	region = region & cv::Rect(0, 0, dstSize.width, dstSize.height);
+	if(region.width <= 0 || region.height <= 0 || frameSize.width <= 0 || frameSize.height <= 0){
+		dst.release();
+		return;
+	}
+	dst.create(region.size(), CV_8UC4);
+
+	//Source column and row for every destination column and row, computed once per call
+	std::vector<int> xmap, ymap;
+	getScaleMap(xmap, region.x, region.width, frameSize.width, dstSize.width);
+	getScaleMap(ymap, region.y, region.height, frameSize.height, dstSize.height);
+
+	cv::parallel_for_(cv::Range(0, region.height), [&](const cv::Range &range){
+		for(int y = range.start; y < range.end; y++){
+			int sy = ymap[y];
+			uchar *out = dst.ptr(y);
+
+			if(format == YUV_YUYV){
+				const uchar *row = src.ptr(sy);
+				for(int x = 0; x < region.width; x++){
+					int sx = xmap[x];
+					const uchar *pair = row + (sx & ~1) * 2;
+					putYUVPixel(t, out + x * 4, row[sx * 2], pair[1], pair[3]);
+				}
+			}
+			else{
+				const uchar *row = src.ptr(sy);
+				const uchar *uv = src.ptr(frameSize.height + sy / 2);
+				for(int x = 0; x < region.width; x++){
+					int sx = xmap[x];
+					putYUVPixel(t, out + x * 4, row[sx], uv[sx & ~1], uv[(sx & ~1) + 1]);
+				}
+			}
+		}
+	});
+}
+
+#endif
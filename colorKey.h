@@ -0,0 +1,201 @@
+#ifndef COLOR_KEY_H
+#define COLOR_KEY_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <tuple>
+#include <mutex>
+#include <cmath>
+#include <map>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define KEY_CHROMA_BITS 7    //Bits of each chroma axis indexing the chroma key table, 16 KB fits in L1
+#define KEY_MIN_CHROMA 12    //Colors with less chroma than this are never chroma keyed, so grays and skin stay
+#define KEY_FULL_CHROMA 32   //Chroma at which a matching hue is fully keyed
+#define KEY_LUMA_BITS 12     //Fraction bits of the luma key gain
+
+enum KeyType{
+	KEY_CHROMA,
+	KEY_LUMA
+};
+
+//Alpha multipliers for every color, baked once per set of key settings
+struct KeyTable{
+	KeyType type;
+
+	//Luma key, a ramp computed per pixel: ((luma - lumaLow) * lumaGain) >> KEY_LUMA_BITS, clamped to 0 to 255
+	int lumaLow;
+	int lumaGain;
+
+	//Chroma key, indexed by the top KEY_CHROMA_BITS of Cb then Cr
+	std::vector<uchar> chroma;
+};
+
+//BT.601 luma and chroma of a BGR pixel, chroma from -128 to 127
+static inline int keyLuma(const uchar *p){
+	return (29 * p[0] + 150 * p[1] + 77 * p[2] + 128) >> 8;
+}
+static inline int keyCb(const uchar *p){
+	return (112 * p[0] - 74 * p[1] - 38 * p[2]) >> 8;
+}
+static inline int keyCr(const uchar *p){
+	return (-18 * p[0] - 94 * p[1] + 112 * p[2]) >> 8;
+}
+
+static inline float keyRamp(float x){
+	return std::max(0.0f, std::min(1.0f, x));
+}
+
+static inline int keyLumaAlpha(const KeyTable &table, int y){
+	int k = ((y - table.lumaLow) * table.lumaGain + (1 << (KEY_LUMA_BITS - 1))) >> KEY_LUMA_BITS;
+	return std::max(0, std::min(255, k));
+}
+
+//Build the table keying out hue [hue] in degrees, within [tolerance] degrees, fading out over a further [softness]
+static std::shared_ptr<KeyTable> buildChromaKey(int hue, int tolerance, float softness){
+	std::shared_ptr<KeyTable> table = std::make_shared<KeyTable>();
+	table->type = KEY_CHROMA;
+
+	//Direction of the key hue in the chroma plane, from a fully saturated color of that hue
+	float h = std::fmod(std::fmod((float)hue, 360.0f) + 360.0f, 360.0f) / 60.0f;
+	float x = 1 - std::abs(std::fmod(h, 2.0f) - 1);
+	float r = 0, g = 0, b = 0;
+	switch((int)h){
+		case 0: r = 1; g = x; break;
+		case 1: r = x; g = 1; break;
+		case 2: g = 1; b = x; break;
+		case 3: g = x; b = 1; break;
+		case 4: r = x; b = 1; break;
+		default: r = 1; b = x; break;
+	}
+	float keyAngle = std::atan2(-0.071f * b - 0.367f * g + 0.438f * r, 0.438f * b - 0.289f * g - 0.148f * r);
+
+	int cells = 1 << KEY_CHROMA_BITS, shift = 8 - KEY_CHROMA_BITS;
+	table->chroma.resize(cells * cells);
+	for(int u = 0; u < cells; u++){
+		for(int v = 0; v < cells; v++){
+			//Center of the cell
+			float cb = ((u << shift) - 128) + (1 << shift) / 2.0f;
+			float cr = ((v << shift) - 128) + (1 << shift) / 2.0f;
+			float distance = std::abs(std::remainder(std::atan2(cr, cb) - keyAngle, 2 * (float)M_PI)) * 180 / (float)M_PI;
+			float hueMatch = softness > 0 ? keyRamp((tolerance + softness - distance) / softness) : (distance <= tolerance ? 1 : 0);
+			float chromaMatch = keyRamp((std::sqrt(cb * cb + cr * cr) - KEY_MIN_CHROMA) / (KEY_FULL_CHROMA - KEY_MIN_CHROMA));
+			table->chroma[u * cells + v] = (uchar)std::lround(255 * (1 - hueMatch * chromaMatch));
+		}
+	}
+	return table;
+}
+
+//Build the ramp keying out luma below [low], fading in until [high]. If [low] is above [high], bright colors are keyed out.
+//The ramp is arithmetic rather than a table, so it is computed with the luma in the same SIMD pass
+static std::shared_ptr<KeyTable> buildLumaKey(int low, int high){
+	std::shared_ptr<KeyTable> table = std::make_shared<KeyTable>();
+	table->type = KEY_LUMA;
+	//A ramp entirely outside the luma range keys every color the same, and its gain could overflow
+	if(std::max(low, high) < 0 || std::min(low, high) > 255){
+		bool kept = std::max(low, high) < 0 ? low <= high : low > high;
+		table->lumaLow = -1;
+		table->lumaGain = kept ? 255 << KEY_LUMA_BITS : 0;
+	}
+	else if(low == high){
+		//A step at [high]
+		table->lumaLow = high - 1;
+		table->lumaGain = 255 << KEY_LUMA_BITS;
+	}
+	else{
+		table->lumaLow = low;
+		table->lumaGain = (int)std::lround(255.0 * (1 << KEY_LUMA_BITS) / (high - low));
+	}
+	return table;
+}
+
+//Returns the table for a key, baked the first time its settings are used and shared
+static std::shared_ptr<const KeyTable> getKeyTable(KeyType type, int a, int b, float softness=0){
+	static std::mutex mut;
+	static std::map<std::tuple<int, int, int, float>, std::shared_ptr<const KeyTable>> cache;
+
+	std::lock_guard<std::mutex> lock(mut);
+	std::shared_ptr<const KeyTable> &table = cache[std::make_tuple((int)type, a, b, softness)];
+	if(!table){
+		table = type == KEY_CHROMA ? buildChromaKey(a, b, softness) : buildLumaKey(a, b);
+	}
+	return table;
+}
+
+static inline void writeKeyAlpha(uchar *p, int k, bool opaque){
+	if(opaque){
+		p[3] = k;
+	}
+	else{
+		int a = p[3] * k + 128;
+		p[3] = (a + (a >> 8)) >> 8;
+	}
+}
+
+//Multiply the alpha of [count] straight alpha BGRA pixels by [table], or write it if [opaque]
+static void applyKeyRow(uchar *p, int count, const KeyTable &table, bool opaque){
+	int x = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	//8 pixels at a time, split into channels, with the same rounding as keyLuma, keyCb, keyCr and writeKeyAlpha
+	for(; x + 8 <= count; x += 8, p += 32){
+		uint8x8x4_t px = vld4_u8(p);
+		uint8x8_t k;
+		if(table.type == KEY_LUMA){
+			uint16x8_t weighted = vmlal_u8(vmlal_u8(vmull_u8(px.val[0], vdup_n_u8(29)), px.val[1], vdup_n_u8(150)), px.val[2], vdup_n_u8(77));
+			int16x8_t y = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(vrshrn_n_u16(weighted, 8))), vdupq_n_s16(table.lumaLow));
+			int32x4_t low = vrshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_low_s16(y)), table.lumaGain), KEY_LUMA_BITS);
+			int32x4_t high = vrshrq_n_s32(vmulq_n_s32(vmovl_s16(vget_high_s16(y)), table.lumaGain), KEY_LUMA_BITS);
+			k = vqmovn_u16(vcombine_u16(vqmovun_s32(low), vqmovun_s32(high)));
+		}
+		else{
+			//Chroma wraps in 16 bits but always fits signed, then the table is read a pixel at a time
+			int16x8_t cb = vreinterpretq_s16_u16(vmlsl_u8(vmlsl_u8(vmull_u8(px.val[0], vdup_n_u8(112)), px.val[1], vdup_n_u8(74)), px.val[2], vdup_n_u8(38)));
+			int16x8_t cr = vreinterpretq_s16_u16(vmlsl_u8(vmlsl_u8(vmull_u8(px.val[2], vdup_n_u8(112)), px.val[1], vdup_n_u8(94)), px.val[0], vdup_n_u8(18)));
+			int16x8_t u = vshrq_n_s16(vaddq_s16(vshrq_n_s16(cb, 8), vdupq_n_s16(128)), 8 - KEY_CHROMA_BITS);
+			int16x8_t v = vshrq_n_s16(vaddq_s16(vshrq_n_s16(cr, 8), vdupq_n_s16(128)), 8 - KEY_CHROMA_BITS);
+			uint16_t index[8];
+			uchar alpha[8];
+			vst1q_u16(index, vreinterpretq_u16_s16(vaddq_s16(vshlq_n_s16(u, KEY_CHROMA_BITS), v)));
+			for(int i = 0; i < 8; i++){
+				alpha[i] = table.chroma[index[i]];
+			}
+			k = vld1_u8(alpha);
+		}
+		if(opaque){
+			px.val[3] = k;
+		}
+		else{
+			uint16x8_t product = vmull_u8(px.val[3], k);
+			px.val[3] = vraddhn_u16(product, vrshrq_n_u16(product, 8));
+		}
+		vst4_u8(p, px);
+	}
+#endif
+	int shift = 8 - KEY_CHROMA_BITS;
+	for(; x < count; x++, p += 4){
+		if(table.type == KEY_LUMA){
+			writeKeyAlpha(p, keyLumaAlpha(table, keyLuma(p)), opaque);
+		}
+		else{
+			int u = (keyCb(p) + 128) >> shift, v = (keyCr(p) + 128) >> shift;
+			writeKeyAlpha(p, table.chroma[(u << KEY_CHROMA_BITS) + v], opaque);
+		}
+	}
+}
+
+//Multiply the alpha of a straight alpha BGRA image by [table] in place, in one pass. Alpha is written rather than
+//multiplied if the image is [opaque]
+static void applyKeyTable(cv::Mat &image, const KeyTable &table, bool opaque){
+	cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range){
+		for(int y = range.start; y < range.end; y++){
+			applyKeyRow(image.ptr(y), image.cols, table, opaque);
+		}
+	});
+}
+
+#endif
@@ -0,0 +1,318 @@
+#ifndef COLOR_LUT_H
+#define COLOR_LUT_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <cmath>
+#include <map>
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#define LUT_DIRECTORY "./Luts/"
+#define LUT_BITS 4            //Fraction bits kept in 3D table entries, 12-bit color
+#define LUT_IDENTITY_ERROR 0.5 //Largest difference from identity, in 8-bit steps, for a LUT to be skipped
+
+//Color lookup table from a .cube file, packed for 8-bit BGRA images
+struct ColorLut{
+	bool identity = false;    //Changes nothing, so is skipped
+	bool separable = false;   //Each output channel only depends on the same input channel, applied with curves
+
+	//Per-channel curves, in BGR order, for separable LUTs
+	uchar curves[3][256];
+
+	//3D table, [size] entries per axis, blue slowest and red fastest, each entry B, G, R and padding
+	//with LUT_BITS fraction bits, so the eight corners of a cell are four cache lines at most
+	int size = 0;
+	std::vector<int16_t> table;
+
+	//Cell and 8-bit fraction along an axis for every input value
+	uint16_t cell[256];
+	uint16_t fraction[256];
+};
+
+//Read a .cube file into [red], [green] and [blue] values from 0 to 1, returns false on failure
+static bool readCubeFile(std::string filename, int *size, bool *oneD, std::vector<float> *values){
+	std::ifstream file(filename);
+	if(!file.is_open()){
+		printf("Error: Unable to open LUT %s\n", filename.c_str());
+		return false;
+	}
+	*size = 0;
+	*oneD = false;
+	float domainMin[3] = {0, 0, 0}, domainMax[3] = {1, 1, 1};
+	std::string line;
+	while(std::getline(file, line)){
+		std::istringstream words(line);
+		std::string key;
+		if(!(words >> key) || key[0] == '#' || key == "TITLE"){
+			continue;
+		}
+		if(key == "LUT_1D_SIZE" || key == "LUT_3D_SIZE"){
+			words >> *size;
+			*oneD = key == "LUT_1D_SIZE";
+		}
+		else if(key == "DOMAIN_MIN"){
+			words >> domainMin[0] >> domainMin[1] >> domainMin[2];
+		}
+		else if(key == "DOMAIN_MAX"){
+			words >> domainMax[0] >> domainMax[1] >> domainMax[2];
+		}
+		else{
+			//Table row, scaled to the domain
+			float rgb[3];
+			std::istringstream row(line);
+			if(!(row >> rgb[0] >> rgb[1] >> rgb[2])){
+				printf("Error: Invalid line in LUT %s: %s\n", filename.c_str(), line.c_str());
+				return false;
+			}
+			for(int c = 0; c < 3; c++){
+				float range = domainMax[c] - domainMin[c];
+				values->push_back(range > 0 ? (rgb[c] - domainMin[c]) / range : rgb[c]);
+			}
+		}
+	}
+	size_t expected = *oneD ? (size_t)*size * 3 : (size_t)*size * *size * *size * 3;
+	if(*size < 2 || *size > 256 || values->size() != expected){
+		printf("Error: LUT %s has %d entries, expected %d\n", filename.c_str(), (int)(values->size() / 3), (int)(expected / 3));
+		return false;
+	}
+	return true;
+}
+
+//Sample channel [c] of a 1D table of [size] entries at [x] from 0 to 1
+static float sampleCurve(const std::vector<float> &values, int size, int c, float x){
+	float position = x * (size - 1);
+	int i = std::min((int)position, size - 2);
+	float f = position - i;
+	return values[i * 3 + c] * (1 - f) + values[(i + 1) * 3 + c] * f;
+}
+
+static inline uchar toByte(float v){
+	return (uchar)std::max(0, std::min(255, (int)std::lround(v * 255)));
+}
+
+//Build the packed LUT for a .cube file, returns null if it can't be read
+static std::shared_ptr<ColorLut> buildColorLut(std::string filename){
+	int size;
+	bool oneD;
+	std::vector<float> values;
+	if(!readCubeFile(filename, &size, &oneD, &values)){
+		return nullptr;
+	}
+	std::shared_ptr<ColorLut> lut = std::make_shared<ColorLut>();
+	lut->size = size;
+
+	//1D tables, and 3D tables whose channels don't interact, become curves
+	lut->separable = oneD;
+	if(!oneD){
+		lut->separable = true;
+		for(int b = 0; b < size && lut->separable; b++){
+			for(int g = 0; g < size && lut->separable; g++){
+				for(int r = 0; r < size && lut->separable; r++){
+					const float *v = &values[((b * size + g) * size + r) * 3];
+					lut->separable = std::abs(v[0] - values[r * 3]) * 255 < LUT_IDENTITY_ERROR &&
+					                 std::abs(v[1] - values[(g * size) * 3 + 1]) * 255 < LUT_IDENTITY_ERROR &&
+					                 std::abs(v[2] - values[(b * size * size) * 3 + 2]) * 255 < LUT_IDENTITY_ERROR;
+				}
+			}
+		}
+	}
+	if(lut->separable){
+		//Red, green and blue curves run along the edges of a 3D table from black
+		std::vector<float> curve(size * 3);
+		for(int i = 0; i < size; i++){
+			curve[i * 3] = values[i * 3];
+			curve[i * 3 + 1] = values[(oneD ? i : i * size) * 3 + 1];
+			curve[i * 3 + 2] = values[(oneD ? i : i * size * size) * 3 + 2];
+		}
+		lut->identity = true;
+		for(int x = 0; x < 256; x++){
+			for(int c = 0; c < 3; c++){
+				float v = sampleCurve(curve, size, c, x / 255.0f);
+				lut->curves[2 - c][x] = toByte(v);
+				lut->identity = lut->identity && std::abs(v * 255 - x) < LUT_IDENTITY_ERROR;
+			}
+		}
+		return lut;
+	}
+
+	//Packed 3D table
+	lut->table.resize((size_t)size * size * size * 4);
+	for(size_t i = 0; i < (size_t)size * size * size; i++){
+		for(int c = 0; c < 3; c++){
+			float v = std::max(0.0f, std::min(1.0f, values[i * 3 + c]));
+			lut->table[i * 4 + (2 - c)] = (int16_t)std::lround(v * (255 << LUT_BITS));
+		}
+		lut->table[i * 4 + 3] = 0;
+	}
+	for(int x = 0; x < 256; x++){
+		int position = x * (size - 1) * 256 / 255;
+		lut->cell[x] = std::min(position >> 8, size - 2);
+		lut->fraction[x] = position - lut->cell[x] * 256;
+	}
+	return lut;
+}
+
+//Returns the LUT in file [name] of the Luts folder, loaded on first use and shared. Null if it can't be read
+static std::shared_ptr<const ColorLut> getColorLut(std::string name){
+	std::string filename = LUT_DIRECTORY + name;
+	static std::mutex mut;
+	static std::map<std::string, std::shared_ptr<const ColorLut>> cache;
+
+	std::lock_guard<std::mutex> lock(mut);
+	std::map<std::string, std::shared_ptr<const ColorLut>>::iterator found = cache.find(filename);
+	if(found != cache.end()){
+		return found->second;
+	}
+	std::shared_ptr<const ColorLut> lut = buildColorLut(filename);
+	if(lut){
+		cache[filename] = lut;
+	}
+	return lut;
+}
+
+//Tetrahedral interpolation of one pixel: the cell is split into six tetrahedra along its diagonal,
+//and the four corners of the one holding the pixel are weighted by the sorted fractions
+static inline void interpolateTetrahedral(const ColorLut &lut, const uchar *in, uchar *out){
+	const int16_t *t = lut.table.data();
+	int size = lut.size;
+	int fr = lut.fraction[in[2]], fg = lut.fraction[in[1]], fb = lut.fraction[in[0]];
+	int strideG = size * 4, strideB = size * size * 4;
+	const int16_t *c000 = t + lut.cell[in[0]] * strideB + lut.cell[in[1]] * strideG + lut.cell[in[2]] * 4;
+	const int16_t *c111 = c000 + strideB + strideG + 4;
+
+	//Second and third corners, and the weights of all four
+	const int16_t *a, *b;
+	int w0, w1, w2, w3;
+	if(fr >= fg){
+		if(fg >= fb){      a = c000 + 4;       b = a + strideG;     w0 = 256 - fr; w1 = fr - fg; w2 = fg - fb; w3 = fb; }
+		else if(fr >= fb){ a = c000 + 4;       b = a + strideB;     w0 = 256 - fr; w1 = fr - fb; w2 = fb - fg; w3 = fg; }
+		else{              a = c000 + strideB; b = a + 4;           w0 = 256 - fb; w1 = fb - fr; w2 = fr - fg; w3 = fg; }
+	}
+	else{
+		if(fr >= fb){      a = c000 + strideG; b = a + 4;           w0 = 256 - fg; w1 = fg - fr; w2 = fr - fb; w3 = fb; }
+		else if(fg >= fb){ a = c000 + strideG; b = a + strideB;     w0 = 256 - fg; w1 = fg - fb; w2 = fb - fr; w3 = fr; }
+		else{              a = c000 + strideB; b = a + strideG;     w0 = 256 - fb; w1 = fb - fg; w2 = fg - fr; w3 = fr; }
+	}
+	for(int c = 0; c < 3; c++){
+		int v = c000[c] * w0 + a[c] * w1 + b[c] * w2 + c111[c] * w3;
+		out[c] = (uchar)((v + (1 << (LUT_BITS + 7))) >> (LUT_BITS + 8));
+	}
+}
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+//Offsets into a packed 3D table for four cells, or four steps of one cell along the axes
+static inline uint32x4_t getLutOffsets(const uint16_t *b, const uint16_t *g, const uint16_t *r, uint32_t strideG, uint32_t strideB){
+	return vmlaq_n_u32(vmlaq_n_u32(vshlq_n_u32(vmovl_u16(vld1_u16(r)), 2), vmovl_u16(vld1_u16(g)), strideG), vmovl_u16(vld1_u16(b)), strideB);
+}
+#endif
+
+//Tetrahedral interpolation of [count] BGRA pixels in place, leaving alpha
+static void interpolateTetrahedralRow(const ColorLut &lut, uchar *p, int count){
+	int x = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+	//8 pixels at a time: cells, fractions, the tetrahedron and its weights are found as in buildColorLut and
+	//interpolateTetrahedral, then the four corners are read a pixel at a time and weighted with the same rounding
+	const int16_t *t = lut.table.data();
+	uint32_t strideG = lut.size * 4, strideB = lut.size * lut.size * 4;
+	uint8x16_t alphaMask = vreinterpretq_u8_u32(vdupq_n_u32(0xFF000000));
+	for(; x + 8 <= count; x += 8, p += 32){
+		uint8x8x4_t px = vld4_u8(p);
+		uint16x8_t fraction[3];
+		uint16_t lanes[9][8];
+		for(int c = 0; c < 3; c++){
+			//x * (size - 1) * 256 / 255, as x * (size - 1) plus its exact division by 255
+			uint16x8_t m = vmull_u8(px.val[c], vdup_n_u8(lut.size - 1));
+			uint16x8_t position = vaddq_u16(m, vshrq_n_u16(vaddq_u16(vaddq_u16(m, vdupq_n_u16(1)), vshrq_n_u16(m, 8)), 8));
+			uint16x8_t cell = vminq_u16(vshrq_n_u16(position, 8), vdupq_n_u16(lut.size - 2));
+			fraction[c] = vsubq_u16(position, vshlq_n_u16(cell, 8));
+			vst1q_u16(lanes[c], cell);
+		}
+		uint16x8_t fb = fraction[0], fg = fraction[1], fr = fraction[2];
+
+		//The second corner steps from the first along the largest fraction, the third steps back from the last
+		//along the smallest, each as 0 or 1 per axis in BGR order
+		uint16x8_t rg = vcgeq_u16(fr, fg), gb = vcgeq_u16(fg, fb), rb = vcgeq_u16(fr, fb);
+		uint16x8_t largestB = vmvnq_u16(vorrq_u16(rb, gb));
+		uint16x8_t smallestR = vmvnq_u16(vorrq_u16(rg, rb));
+		uint16x8_t smallestG = vbicq_u16(rg, gb);
+		vst1q_u16(lanes[3], vshrq_n_u16(largestB, 15));
+		vst1q_u16(lanes[4], vshrq_n_u16(vbicq_u16(vmvnq_u16(rg), largestB), 15));
+		vst1q_u16(lanes[5], vshrq_n_u16(vbicq_u16(rg, largestB), 15));
+		vst1q_u16(lanes[6], vshrq_n_u16(vmvnq_u16(vorrq_u16(smallestR, smallestG)), 15));
+		vst1q_u16(lanes[7], vshrq_n_u16(smallestG, 15));
+		vst1q_u16(lanes[8], vshrq_n_u16(smallestR, 15));
+
+		//Weights from the sorted fractions
+		uint16x8_t high = vmaxq_u16(vmaxq_u16(fr, fg), fb), low = vminq_u16(vminq_u16(fr, fg), fb);
+		uint16x8_t middle = vsubq_u16(vsubq_u16(vaddq_u16(vaddq_u16(fr, fg), fb), high), low);
+		int16_t weight[4][8];
+		vst1q_s16(weight[0], vreinterpretq_s16_u16(vsubq_u16(vdupq_n_u16(256), high)));
+		vst1q_s16(weight[1], vreinterpretq_s16_u16(vsubq_u16(high, middle)));
+		vst1q_s16(weight[2], vreinterpretq_s16_u16(vsubq_u16(middle, low)));
+		vst1q_s16(weight[3], vreinterpretq_s16_u16(low));
+
+		uint32_t corner[4][8];
+		uint32x4_t far = vdupq_n_u32(strideB + strideG + 4);
+		for(int h = 0; h < 8; h += 4){
+			uint32x4_t first = getLutOffsets(lanes[0] + h, lanes[1] + h, lanes[2] + h, strideG, strideB);
+			uint32x4_t last = vaddq_u32(first, far);
+			vst1q_u32(corner[0] + h, first);
+			vst1q_u32(corner[1] + h, vaddq_u32(first, getLutOffsets(lanes[3] + h, lanes[4] + h, lanes[5] + h, strideG, strideB)));
+			vst1q_u32(corner[2] + h, vsubq_u32(last, getLutOffsets(lanes[6] + h, lanes[7] + h, lanes[8] + h, strideG, strideB)));
+			vst1q_u32(corner[3] + h, last);
+		}
+
+		//Weighted sum of the four corners of each pixel, padding comes out 0 and alpha is put back
+		uint16x4_t color[8];
+		for(int i = 0; i < 8; i++){
+			int32x4_t v = vmull_n_s16(vld1_s16(t + corner[0][i]), weight[0][i]);
+			v = vmlal_n_s16(v, vld1_s16(t + corner[1][i]), weight[1][i]);
+			v = vmlal_n_s16(v, vld1_s16(t + corner[2][i]), weight[2][i]);
+			v = vmlal_n_s16(v, vld1_s16(t + corner[3][i]), weight[3][i]);
+			color[i] = vqrshrun_n_s32(v, LUT_BITS + 8);
+		}
+		for(int i = 0; i < 2; i++){
+			uint8x16_t colors = vcombine_u8(vmovn_u16(vcombine_u16(color[i * 4], color[i * 4 + 1])), vmovn_u16(vcombine_u16(color[i * 4 + 2], color[i * 4 + 3])));
+			vst1q_u8(p + i * 16, vorrq_u8(colors, vandq_u8(vld1q_u8(p + i * 16), alphaMask)));
+		}
+	}
+#endif
+	for(; x < count; x++, p += 4){
+		interpolateTetrahedral(lut, p, p);
+	}
+}
+
+//Apply [lut] to the color of a BGRA image in place, leaving alpha
+static void applyColorLut(cv::Mat &image, const ColorLut &lut){
+	if(lut.identity || image.empty()){
+		return;
+	}
+	cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range &range){
+		for(int y = range.start; y < range.end; y++){
+			uchar *p = image.ptr(y);
+			if(lut.separable){
+				uchar *end = p + image.cols * 4;
+				for(; p < end; p += 4){
+					p[0] = lut.curves[0][p[0]];
+					p[1] = lut.curves[1][p[1]];
+					p[2] = lut.curves[2][p[2]];
+				}
+			}
+			else{
+				interpolateTetrahedralRow(lut, p, image.cols);
+			}
+		}
+	});
+}
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <mutex>
+
+#include "orientation.h"
+#include "presenter.h"
+#include "resample.h"
+#include "latency.h"
+#include "output.h"
+#include "helper.h"
+
+//How a Display shows the composite
+struct DisplaySettings{
+	float scale = 1;         //Scale applied after cropping
+	ResampleFilter filter = FILTER_BOX; //Filter used when scaling
+	cv::Rect crop;           //Region of the composite shown, empty for all of it
+	int copies = 1;          //Copies side by side, one per Vive eye
+	bool alignRight = false; //Place against the right edge instead of the left
+	double rate = 0;         //Frames per second presented, 0 to present every composite as it arrives
+	bool reproject = false;  //Reproject reused frames to the current orientation
+	int interval = 1;        //Show every [interval]th composite, skipping the rest
+};
+
+//Output showing the shared composite with its own scale, crop, pixel format and rate.
+//Every Display presents on its own thread, so a slow one never holds up the others or the render loop
+class Display{
+private:
+	std::string name;
+	Output *out;
+	DisplaySettings settings;
+	bool enabled = true;
+	LatencyMonitor *latency;
+
+	std::mutex mut; //Guards settings and writes to the Output
+	Presenter presenter;
+	long int composites = 0;
+	cv::Mat scaled, converted;
+
+public:
+	//Display takes ownership of the Output. Latency is recorded to [l] if given
+	Display(std::string n, Output *o, DisplaySettings s, LatencyMonitor *l=0){
+		name = n;
+		out = o;
+		settings = s;
+		latency = l;
+		applyRate();
+	}
+	~Display(){
+		close();
+	}
+
+	//Show a finished composite, which must not be modified afterwards
+	void show(cv::Mat composite, Timestamp captured){
+		if(!enabled || composites++ % settings.interval != 0){
+			return;
+		}
+		presenter.submit(composite, captured);
+	}
+
+	//Write a composite to the Output now, bypassing the presenter
+	void write(cv::Mat composite, Timestamp captured){
+		std::lock_guard<std::mutex> lock(mut);
+		if(out == 0){
+			return;
+		}
+		cv::Mat m = composite;
+
+		//Crop and scale
+		if(settings.crop.area() > 0){
+			m = m(settings.crop & cv::Rect(0, 0, m.cols, m.rows));
+		}
+		if(settings.scale != 1){
+			resample(m, scaled, cv::Size(cvRound(m.cols * settings.scale), cvRound(m.rows * settings.scale)), settings.filter);
+			m = scaled;
+		}
+
+		//Convert to the Output's pixel format
+		if(out->getBitsPerPixel() == 16){
+			cv::cvtColor(m, converted, cv::COLOR_BGRA2BGR565);
+			m = converted;
+		}
+
+		//Place every copy, clipped to the Output
+		int copyWidth = out->getXRes() / std::max(1, settings.copies);
+		int width = std::min(m.cols, copyWidth);
+		int rows = std::min(m.rows, out->getYRes());
+		int x = settings.alignRight ? copyWidth - width : 0;
+		size_t rowSize = m.elemSize() * width;
+		for(int i = 0; i < rows; i++){
+			for(int c = 0; c < settings.copies; c++){
+				out->putRow(m.ptr(i), c * copyWidth + x, i, rowSize);
+			}
+		}
+		out->present();
+
+		//Measure latency from capture to Output write
+		if(latency != 0 && captured != Timestamp()){
+			latency->record(captured, getMonotonicTime());
+		}
+	}
+
+	//Enable or disable, a disabled Display is left blank
+	void setEnabled(bool e, cv::Mat blank){
+		enabled = e;
+		applyRate();
+		if(!enabled){
+			write(blank, Timestamp());
+		}
+	}
+
+	//Present at [rate] frames per second, or every composite as it arrives if 0
+	void setRate(double rate){
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			settings.rate = std::max(0.0, rate);
+		}
+		applyRate();
+	}
+
+	void setScale(float scale){
+		std::lock_guard<std::mutex> lock(mut);
+		settings.scale = scale;
+	}
+
+	void setFilter(ResampleFilter filter){
+		std::lock_guard<std::mutex> lock(mut);
+		settings.filter = filter;
+	}
+
+	//Show every [frames]th composite, 1 for all of them
+	void setInterval(int frames){
+		settings.interval = std::max(1, frames);
+	}
+
+	//Show only [crop] of the composite, an empty Rect shows all of it
+	void setCrop(cv::Rect crop){
+		std::lock_guard<std::mutex> lock(mut);
+		settings.crop = crop;
+	}
+
+	//Touch every page of the Output's memory
+	void prefault(){
+		std::lock_guard<std::mutex> lock(mut);
+		if(out != 0){
+			out->prefault();
+		}
+	}
+
+	void setReprojection(bool r){
+		settings.reproject = r;
+		presenter.setReprojection(r);
+	}
+
+	void setOrientationSource(std::shared_ptr<OrientationSource> s){
+		presenter.setOrientationSource(s);
+	}
+
+	void printInfo(){
+		std::lock_guard<std::mutex> lock(mut);
+		printf("%s: %d X %d, %d bpp, %s, scale %.2f %s", name.c_str(), out->getXRes(), out->getYRes(),
+		       out->getBitsPerPixel(), enabled ? "enabled" : "disabled", settings.scale, getFilterName(settings.filter).c_str());
+		if(settings.crop.area() > 0){
+			printf(", crop %d %d %d %d", settings.crop.x, settings.crop.y, settings.crop.width, settings.crop.height);
+		}
+		if(settings.rate > 0){
+			printf(", %.0f fps%s", settings.rate, settings.reproject ? " with reprojection" : "");
+		}
+		if(settings.interval > 1){
+			printf(", every %d frames", settings.interval);
+		}
+		printf("\n");
+	}
+
+	//Get methods
+	std::string getName(){
+		return name;
+	}
+	double getRate(){
+		return settings.rate;
+	}
+	bool isEnabled(){
+		return enabled;
+	}
+
+	//Stop presenting and release the Output
+	void close(){
+		presenter.stop();
+		std::lock_guard<std::mutex> lock(mut);
+		if(out != 0){
+			out->closeOutput();
+			delete out;
+			out = 0;
+		}
+	}
+
+private:
+	//Restart the presenter at the rate, a disabled Display never presents
+	void applyRate(){
+		presenter.stop();
+		presenter.setReprojection(settings.reproject);
+		if(enabled){
+			presenter.start([this](cv::Mat m, Timestamp captured){
+				write(m, captured);
+			}, settings.rate);
+		}
+	}
+};
+
+#endif
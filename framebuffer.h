@@ -8,9 +8,11 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include "output.h"
+
 #define TARGET_BPP 32
 
-class Framebuffer{
+class Framebuffer : public Output{
 private:
 	int fbfd;
 	char *fbp;
@@ -20,30 +22,37 @@ private:
 
 public:
 	Framebuffer() {}
-	Framebuffer(const char *fbName){
-		fbfd = 0;
+	//Open framebuffer [fbName] at [bpp] bits per pixel, 32 for BGRA or 16 for BGR565
+	Framebuffer(const char *fbName, int bpp=TARGET_BPP){
+		fbfd = -1;
 		fbp = 0;
 		screenSize = 0;
+		var_info = {};
+		fix_info = {};
 
 		printf("Opening framebuffer %s...\n", fbName);
 
 		//Open framebuffer device
 		fbfd = open(fbName, O_RDWR);
-		if(!fbfd){
+		if(fbfd < 0){
 			printf("Error: Unable to open framebuffer device\n");
+			return;
 		}
 		printf("Framebuffer device opened\n");
 	
-		//Get variable screen info, set bits per pixel to TARGET_BPP
+		//Get variable screen info, set bits per pixel to bpp
 		if(ioctl(fbfd, FBIOGET_VSCREENINFO, &var_info)){
 			printf("Error: Unable to read variable screen info for device\n");
 		}
-		if(var_info.bits_per_pixel != TARGET_BPP){
-			var_info.bits_per_pixel = TARGET_BPP;
+		if(var_info.bits_per_pixel != bpp){
+			var_info.bits_per_pixel = bpp;
 			if(ioctl(fbfd, FBIOPUT_VSCREENINFO, &var_info)){
 				printf("Error: Unable to change bits per pixel\n");
 			}
-			printf("Changed bits per pixel to %d\n", TARGET_BPP);
+			else{
+				printf("Changed bits per pixel to %d\n", bpp);
+			}
+			ioctl(fbfd, FBIOGET_VSCREENINFO, &var_info);
 		}
 	
 		//Get fixed screen info
@@ -55,8 +64,12 @@ public:
 		screenSize = fix_info.smem_len;
 		fbp = (char*)mmap(0, screenSize, PROT_READ | PROT_WRITE, MAP_SHARED, fbfd, 0);
 	
-		if((int)fbp == -1){
+		if(fbp == MAP_FAILED){
 			printf("Error: Unable to memory map device\n");
+			fbp = 0;
+			close(fbfd);
+			fbfd = -1;
+			return;
 		}
 	
 		printf("Framebuffer successfully initialized\n");
@@ -64,13 +77,15 @@ public:
 
 	//Place row of color data
 	void putRow(uchar* row, int x, int y, size_t size){
-		int pix_offset = x * (TARGET_BPP / 8) + y * fix_info.line_length;
+		if(fbp == 0){ return; }
+		int pix_offset = x * (var_info.bits_per_pixel / 8) + y * fix_info.line_length;
 
 		memcpy((char*)(fbp+pix_offset), row, size);
 	}
 
 	//Change pixel (x, y) to color c
 	void putPixel(int x, int y, cv::Vec4b c){
+		if(fbp == 0){ return; }
 		int pix_offset = x * (TARGET_BPP / 8) + y * fix_info.line_length;
 		
 		*((char*)(fbp + pix_offset)) = c[0];
@@ -78,16 +93,48 @@ public:
 		*((char*)(fbp + pix_offset + 2)) = c[2];
 	}	
 
+	//Touch every page of the memory map, keeping its contents
+	void prefault(){
+		if(fbp == 0){ return; }
+		long int pageSize = sysconf(_SC_PAGESIZE);
+		for(long int i = 0; i < screenSize; i += pageSize){
+			volatile char *p = fbp + i;
+			*p = *p;
+		}
+	}
+
 	//Release memory
 	void closeFramebuffer(){
-		munmap(fbp, screenSize);
-		close(fbfd);
+		if(fbp != 0){
+			munmap(fbp, screenSize);
+			fbp = 0;
+		}
+		if(fbfd >= 0){
+			close(fbfd);
+			fbfd = -1;
+		}
+	}
+	void closeOutput(){
+		closeFramebuffer();
 	}
 
 	//Return variable info
 	fb_var_screeninfo getVarInfo(){
 		return var_info;
 	}
+
+	int getXRes(){
+		return var_info.xres;
+	}
+	int getYRes(){
+		return var_info.yres;
+	}
+	int getBitsPerPixel(){
+		return var_info.bits_per_pixel;
+	}
+	bool isOpen(){
+		return fbp != 0;
+	}
 };
 
 #endif
@@ -0,0 +1,123 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/core.hpp>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstring>
+#include <string>
+
+#include "output.h"
+
+//Output that renders into memory, or into a file-backed memory map, instead of a display
+class HeadlessOutput : public Output{
+private:
+	int xres, yres;
+	int fd = -1;
+	char *mapped = 0;
+	size_t mapSize = 0;
+	cv::Mat frame;
+
+	long int frameCount = 0;
+	int pngInterval = 0;
+	std::string pngPrefix = "";
+
+public:
+	HeadlessOutput() {}
+
+	//Render into memory, or into raw file [rawFile] if given
+	HeadlessOutput(int x, int y, std::string rawFile=""){
+		xres = x;
+		yres = y;
+		mapSize = (size_t)xres * yres * sizeof(cv::Vec4b);
+
+		if(rawFile != ""){
+			fd = open(rawFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+			if(fd < 0 || ftruncate(fd, mapSize) != 0){
+				printf("Error: Unable to open headless output file %s\n", rawFile.c_str());
+			}
+			else{
+				mapped = (char*)mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+				if(mapped == MAP_FAILED){
+					printf("Error: Unable to memory map headless output file %s\n", rawFile.c_str());
+					mapped = 0;
+				}
+			}
+		}
+
+		if(mapped != 0){
+			frame = cv::Mat(yres, xres, CV_8UC4, mapped);
+			printf("Headless output %d X %d mapped to %s\n", xres, yres, rawFile.c_str());
+		}
+		else{
+			frame = cv::Mat(yres, xres, CV_8UC4, cv::Scalar(0, 0, 0, 255));
+			printf("Headless output %d X %d created in memory\n", xres, yres);
+		}
+	}
+
+	//Write frame to [prefix]_[FRAME].png once every [interval] frames, 0 to disable
+	void setPngOutput(std::string prefix, int interval){
+		pngPrefix = prefix;
+		pngInterval = interval;
+	}
+
+	//Place row of color data
+	void putRow(uchar* row, int x, int y, size_t size){
+		if(y < 0 || y >= yres || x < 0 || x >= xres){ return; }
+		size = std::min(size, (size_t)(xres - x) * sizeof(cv::Vec4b));
+		memcpy(frame.ptr(y) + x * sizeof(cv::Vec4b), row, size);
+	}
+
+	//Count finished frame, dump to PNG if requested
+	void present(){
+		frameCount++;
+		if(pngInterval > 0 && frameCount % pngInterval == 0){
+			cv::imwrite(pngPrefix + "_" + std::to_string(frameCount) + ".png", frame);
+		}
+	}
+
+	//Release memory
+	void closeOutput(){
+		if(mapped != 0){
+			msync(mapped, mapSize, MS_SYNC);
+			munmap(mapped, mapSize);
+			mapped = 0;
+		}
+		if(fd >= 0){
+			close(fd);
+			fd = -1;
+		}
+		frame.release();
+	}
+
+	//Get methods
+	cv::Mat getFrame(){
+		return frame;
+	}
+	long int getFrameCount(){
+		return frameCount;
+	}
+	int getXRes(){
+		return xres;
+	}
+	int getYRes(){
+		return yres;
+	}
+	bool isOpen(){
+		return !frame.empty();
+	}
+
+	//Touch every page of the frame, keeping its contents
+	void prefault(){
+		long int pageSize = sysconf(_SC_PAGESIZE);
+		size_t size = frame.total() * frame.elemSize();
+		for(size_t i = 0; i < size; i += pageSize){
+			volatile uchar *p = frame.data + i;
+			*p = *p;
+		}
+	}
+};
+
+#endif
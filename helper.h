@@ -3,6 +3,9 @@
 
 #include <chrono>
 #include <string>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
 
 //Functions to measure execution time
 /* auto start = getTime();
@@ -20,6 +23,18 @@ void printTime(std::string message, std::chrono::time_point<std::chrono::high_re
 	std::cout << message << ": " << duration.count() << " s" << std::endl;
 }
 
+//Monotonic timestamps, on the same clock as V4L2 buffer timestamps
+typedef std::chrono::steady_clock::time_point Timestamp;
+
+Timestamp getMonotonicTime(){
+	return std::chrono::steady_clock::now();
+}
+
+double getMilliseconds(Timestamp startTime, Timestamp stopTime){
+	std::chrono::duration<double, std::milli> duration = stopTime - startTime;
+	return duration.count();
+}
+
 //Priority mutex locking/unlocking
 //https://stackoverflow.com/questions/11666610/how-to-give-priority-to-privileged-thread-in-mutex-locking
 struct priorityMutex{
@@ -51,13 +66,13 @@ void highPriorityUnlock(priorityMutex pm){
 }
 
 //Functions to parse integers from strings
-bool canParseInteger(std::string word){
-	try{
-		std::stoi(word);
-	}
-	catch(std::out_of_range const &ex){ return false; }
-	catch(std::invalid_argument const &ex){ return false; }
-	return true;
+//canParseInteger accepts the same input as std::stoi, without the cost of exceptions
+bool canParseInteger(const std::string &word){
+	const char *start = word.c_str();
+	char *end;
+	errno = 0;
+	long int value = strtol(start, &end, 10);
+	return end != start && errno != ERANGE && value >= INT_MIN && value <= INT_MAX;
 }
 
 int parseInteger(std::string word){
@@ -71,13 +86,13 @@ int parseInteger(std::string word){
 }
 
 //Functions to parse floats from strings
-bool canParseFloat(std::string word){
-	try{
-		std::stof(word);
-	}
-	catch(std::out_of_range const &ex){ return false; }
-	catch(std::invalid_argument const &ex){ return false; }
-	return true;
+//canParseFloat accepts the same input as std::stof, without the cost of exceptions
+bool canParseFloat(const std::string &word){
+	const char *start = word.c_str();
+	char *end;
+	errno = 0;
+	strtof(start, &end);
+	return end != start && errno != ERANGE;
 }
 
 float parseFloat(std::string word){
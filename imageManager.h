@@ -6,55 +6,234 @@
 #include <dirent.h>
 #include <iostream>
 #include <string>
+#include <vector>
+#include <mutex>
 #include <map>
 
+#include "resample.h"
 #include "layer.h"
+#include "helper.h"
 
+#define IMAGE_CACHE_BUDGET 128 //Default MB of decoded images and mip levels kept in memory
+#define IMAGE_CACHE_GRACE 1    //Seconds a level stays resident after its last use, whatever the budget
+#define IMAGE_MIN_LEVEL 8      //Smallest mip level dimension built
+
+//Loads every image in a folder, keeping a mip pyramid of each. Levels are built when first used and evicted,
+//least recently used first, once the cache is over its memory budget. An evicted full size image is decoded again if needed
 class ImageManager{
 private:
-	std::map<std::string, Layer> images = {};
+	struct CachedImage{
+		std::string path;
+		std::vector<cv::Size> sizes;  //Size of every level, level 0 is the full image
+		std::vector<Layer> levels;    //Empty if not resident
+		std::vector<Timestamp> used;
+	};
+	std::map<std::string, CachedImage> images;
+	size_t budget = (size_t)IMAGE_CACHE_BUDGET << 20;
+	size_t resident = 0;
+	std::mutex mut;
 
 	DIR *dpdf; //Directory
 	struct dirent *epdf; //Found file
 public:
 	ImageManager() {}
-	ImageManager(std::string path){
-		cv::Mat temp;
+	ImageManager(const ImageManager&) = delete;
+	ImageManager &operator=(const ImageManager&) = delete;
 
-		//Read directory for images
+	//Read directory for images
+	void load(std::string path){
+		std::lock_guard<std::mutex> lock(mut);
 		dpdf = opendir(path.c_str());
 		if(dpdf != NULL){
 			while(epdf = readdir(dpdf)){
-				temp = cv::imread(path + (epdf->d_name));
-				if(temp.data != NULL){
-					images.insert(std::pair<std::string, Layer>(std::string(epdf->d_name), Layer(temp)));
-					std::cout << 
-						epdf->d_name << 
-						" inserted, Raw Channels=" << temp.channels() << 
-						", Raw Depth ID=" << temp.depth() << 
-					std::endl;
+				CachedImage image;
+				image.path = path + (epdf->d_name);
+				Layer full = decode(image.path);
+				if(full.getImage().empty()){
+					continue;
+				}
+
+				//Sizes of every level, halving down to IMAGE_MIN_LEVEL
+				cv::Size size = full.getFullSize();
+				image.sizes.push_back(size);
+				while(size.width >= IMAGE_MIN_LEVEL * 2 && size.height >= IMAGE_MIN_LEVEL * 2){
+					size = cv::Size(size.width / 2, size.height / 2);
+					image.sizes.push_back(size);
 				}
+				image.levels.resize(image.sizes.size());
+				image.used.resize(image.sizes.size());
+				image.levels[0] = full;
+				image.used[0] = getMonotonicTime();
+				resident += getBytes(full);
+				images.insert(std::pair<std::string, CachedImage>(std::string(epdf->d_name), image));
+				std::cout <<
+					epdf->d_name <<
+					" inserted, " << image.sizes[0].width << "x" << image.sizes[0].height <<
+					", " << image.sizes.size() << " levels" <<
+				std::endl;
 			}
 			std::cout << images.size() << " images added to ImageManager" << std::endl;
+			closedir(dpdf);
 		}
-		closedir(dpdf);
+		evict(false);
 	}
 
-	//Get image from map
+	//Get full size image from map
 	Layer getImage(std::string name){
-		std::map<std::string, Layer>::iterator i = images.find(name);
+		return getImage(name, cv::Size());
+	}
+
+	//Get the smallest level of image [name] at least [minSize], to be resized to [minSize]
+	Layer getImage(std::string name, cv::Size minSize){
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<std::string, CachedImage>::iterator i = images.find(name);
 		if(i == images.end()){
 			std::cout << "Error: Image not found" << std::endl;
 			return Layer();
 		}
-		return i->second;
+		CachedImage &image = i->second;
+		int level = findLevel(image, minSize);
+		if(image.levels[level].getImage().empty()){
+			buildLevel(image, level);
+			evict(true);
+		}
+		image.used[level] = getMonotonicTime();
+		return image.levels[level];
+	}
+
+	//Size of the level of image [name] returned for [minSize], or an empty size if the image doesn't exist
+	cv::Size getLevelSize(std::string name, cv::Size minSize=cv::Size()){
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<std::string, CachedImage>::iterator i = images.find(name);
+		if(i == images.end()){
+			return cv::Size();
+		}
+		return i->second.sizes[findLevel(i->second, minSize)];
 	}
 
 	//Returns whether [name] is the name of a loaded image
 	bool doesImageExist(std::string name){
-		std::map<std::string, Layer>::iterator i = images.find(name);
+		std::lock_guard<std::mutex> lock(mut);
+		std::map<std::string, CachedImage>::iterator i = images.find(name);
 		return i != images.end();
 	}
+
+	//Set the memory budget in MB, evicting levels not recently used until under it
+	void setBudget(int mb){
+		if(mb <= 0){
+			displayInvalidMessage("Budget must be positive");
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mut);
+		budget = (size_t)mb << 20;
+		evict(true);
+		printf("Image cache budget set to %d MB, %.1f MB resident\n", mb, resident / 1048576.0);
+	}
+
+	//Print every image and its resident levels
+	void print(){
+		std::lock_guard<std::mutex> lock(mut);
+		printf("IMAGE CACHE: %.1f of %.1f MB\n", resident / 1048576.0, budget / 1048576.0);
+		for(std::map<std::string, CachedImage>::iterator i = images.begin(); i != images.end(); i++){
+			printf("  %s %dx%d, levels:", i->first.c_str(), i->second.sizes[0].width, i->second.sizes[0].height);
+			for(int l = 0; l < i->second.levels.size(); l++){
+				if(!i->second.levels[l].getImage().empty()){
+					printf(" %d (%dx%d)", l, i->second.sizes[l].width, i->second.sizes[l].height);
+				}
+			}
+			printf("\n");
+		}
+	}
+
+private:
+	//Decode an image file premultiplied, keeping its alpha channel
+	static Layer decode(std::string path){
+		cv::Mat temp = cv::imread(path, cv::IMREAD_UNCHANGED);
+		if(temp.data == NULL){
+			return Layer();
+		}
+		if(temp.depth() != CV_8U){
+			temp.convertTo(temp, CV_8U, 1 / 257.0);
+		}
+
+		//Premultiply once here, rather than on every overlay
+		Layer image(temp);
+		if(!image.isOpaque()){
+			image.detectOpaque();
+		}
+		image.premultiply();
+		if(!image.isOpaque()){
+			image.analyzeSpans();
+		}
+		return image;
+	}
+
+	//Smallest level with both sides at least [minSize], level 0 if [minSize] is empty
+	static int findLevel(const CachedImage &image, cv::Size minSize){
+		int level = 0;
+		while(minSize.area() > 0 && level + 1 < image.sizes.size() &&
+		      image.sizes[level + 1].width >= minSize.width && image.sizes[level + 1].height >= minSize.height){
+			level++;
+		}
+		return level;
+	}
+
+	//Build [level] by halving from the nearest larger resident level, decoding the file if there is none.
+	//Levels in between are kept as well
+	void buildLevel(CachedImage &image, int level){
+		int source = level;
+		while(source >= 0 && image.levels[source].getImage().empty()){
+			source--;
+		}
+		if(source < 0){
+			source = 0;
+			image.levels[0] = decode(image.path);
+			resident += getBytes(image.levels[0]);
+		}
+		for(int l = source + 1; l <= level; l++){
+			if(!image.levels[l].getImage().empty()){
+				continue;
+			}
+			//Averaging premultiplied pixels keeps transparent edges from darkening
+			Layer half = image.levels[l - 1];
+			half.resizeLayer(image.sizes[l].width, image.sizes[l].height, FILTER_BOX);
+			if(!half.isOpaque()){
+				half.analyzeSpans();
+			}
+			image.levels[l] = half;
+			image.used[l] = getMonotonicTime();
+			resident += getBytes(half);
+		}
+	}
+
+	//Drop the least recently used levels until under budget. With [grace], levels used in the last
+	//IMAGE_CACHE_GRACE seconds are kept, so the levels of the current frame are never rebuilt every frame
+	void evict(bool grace){
+		Timestamp keep = getMonotonicTime() - std::chrono::seconds(grace ? IMAGE_CACHE_GRACE : 0);
+		while(resident > budget){
+			CachedImage *oldest = 0;
+			int oldestLevel = 0;
+			for(std::map<std::string, CachedImage>::iterator i = images.begin(); i != images.end(); i++){
+				for(int l = 0; l < i->second.levels.size(); l++){
+					if(!i->second.levels[l].getImage().empty() && i->second.used[l] < keep &&
+					   (oldest == 0 || i->second.used[l] < oldest->used[oldestLevel])){
+						oldest = &i->second;
+						oldestLevel = l;
+					}
+				}
+			}
+			if(oldest == 0){
+				return;
+			}
+			resident -= getBytes(oldest->levels[oldestLevel]);
+			oldest->levels[oldestLevel] = Layer();
+		}
+	}
+
+	static size_t getBytes(Layer l){
+		cv::Mat m = l.getImage();
+		return m.total() * m.elemSize();
+	}
 };
 
 #endif
@@ -0,0 +1,558 @@
+#ifndef INSTRUCTIONPLAN_H
+#define INSTRUCTIONPLAN_H
+
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "resample.h"
+#include "helper.h"
+
+//Instruction as entered in the terminal, command words and the flags found for them
+struct Instruction{
+	std::vector<std::string> command;
+	std::vector<int> flags;
+};
+
+//Compiled operation types, stored in binary files, so only ever append
+enum PlanOpType{
+	OP_LAYER_CAMERA,
+	OP_LAYER_IMAGE,
+	OP_RESIZE_DIMENSIONS,
+	OP_RESIZE_SCALE,
+	OP_ROTATE,
+	OP_ALPHA_FLAT,
+	OP_ALPHA_CIRCULAR,
+	OP_TEXT,
+	OP_OVERLAY,
+	OP_DRAW,
+	OP_LAYER_SHARED,
+	OP_LUT,
+	OP_KEY_CHROMA,
+	OP_KEY_LUMA,
+	OP_COUNT
+};
+
+//Compiled Instruction, with arguments parsed and strings interned
+struct PlanOp{
+	int32_t type;
+	int32_t layer;   //String index of the Layer name
+	int32_t source;  //String index of the image file, text or overlaid Layer name, -1 if unused
+	int32_t ints[2];
+	float value;
+	int32_t mode;    //Op specific option, the ResampleFilter of a resize or 1 to expand a rotation
+};
+
+#define PLAN_MAGIC "VTPL"
+#define PLAN_VERSION 2
+
+//Instruction List compiled into typed operations, with a versioned binary file format.
+//Binary layout, little-endian: magic, u32 version, u32 string count, u32 op count,
+//each string as u32 length and bytes, each op as seven 32-bit fields, then a CRC-32 of all prior bytes.
+//Version 1 ops have six fields, without mode
+class InstructionPlan{
+private:
+	std::vector<std::string> strings;
+	std::unordered_map<std::string, int> stringIndex;
+	std::vector<PlanOp> ops;
+
+public:
+	//Compile an Instruction List, returns false if an Instruction was not recognized
+	bool compile(const std::vector<Instruction> &instructions){
+		clear();
+		bool valid = true;
+		for(const Instruction &inst : instructions){
+			PlanOp op;
+			if(compileInstruction(inst, &op)){
+				ops.push_back(op);
+			}
+			else{
+				printf("Error: Unable to compile instruction: %s\n", joinWords(inst.command, 0).c_str());
+				valid = false;
+			}
+		}
+		return valid;
+	}
+
+	//Convert back into an Instruction List
+	std::vector<Instruction> toInstructions() const{
+		std::vector<Instruction> result;
+		for(const PlanOp &op : ops){
+			Instruction inst;
+			std::string name = strings[op.layer];
+			switch(op.type){
+				case OP_LAYER_CAMERA:
+					inst.command = { "layer", name, "camera" };
+					inst.flags = { 10, 20, 201 };
+					break;
+				case OP_LAYER_IMAGE:
+					inst.command = { "layer", name, "image", strings[op.source] };
+					inst.flags = { 10, 20, 202 };
+					break;
+				case OP_LAYER_SHARED:
+					inst.command = { "layer", name, "shm", strings[op.source] };
+					inst.flags = { 10, 20, 203 };
+					break;
+				case OP_RESIZE_DIMENSIONS:
+					inst.command = { "process", name, "resize", "dimensions", std::to_string(op.ints[0]), std::to_string(op.ints[1]) };
+					inst.flags = { 10, 21, 30, 300 };
+					addFilter(&inst, (ResampleFilter)op.mode);
+					break;
+				case OP_RESIZE_SCALE:
+					inst.command = { "process", name, "resize", "scale", formatFloat(op.value) };
+					inst.flags = { 10, 21, 30, 301 };
+					addFilter(&inst, (ResampleFilter)op.mode);
+					break;
+				case OP_ROTATE:
+					inst.command = { "process", name, "rotate", formatFloat(op.value) };
+					inst.flags = { 10, 21, 31 };
+					if(op.mode == 1){
+						inst.command.insert(inst.command.begin() + 3, "expand");
+						inst.flags.push_back(310);
+					}
+					break;
+				case OP_ALPHA_FLAT:
+					inst.command = { "process", name, "alpha", "flat", formatFloat(op.value) };
+					inst.flags = { 10, 21, 32, 320 };
+					break;
+				case OP_ALPHA_CIRCULAR:
+					inst.command = { "process", name, "alpha", "circular", std::to_string(op.ints[0]), std::to_string(op.ints[1]) };
+					inst.flags = { 10, 21, 32, 321 };
+					break;
+				case OP_TEXT:
+					inst.command = { "process", name, "text" };
+					for(const std::string &word : splitString(strings[op.source], " ")){
+						inst.command.push_back(word);
+					}
+					inst.flags = { 10, 21, 33 };
+					break;
+				case OP_OVERLAY:
+					inst.command = { "process", name, "overlay", strings[op.source] };
+					inst.flags = { 10, 21, 34 };
+					break;
+				case OP_LUT:
+					inst.command = { "process", name, "lut", strings[op.source] };
+					inst.flags = { 10, 21, 35 };
+					break;
+				case OP_KEY_CHROMA:
+					inst.command = { "process", name, "key", "chroma", std::to_string(op.ints[0]), std::to_string(op.ints[1]), formatFloat(op.value) };
+					inst.flags = { 10, 21, 36, 360 };
+					break;
+				case OP_KEY_LUMA:
+					inst.command = { "process", name, "key", "luma", std::to_string(op.ints[0]), std::to_string(op.ints[1]) };
+					inst.flags = { 10, 21, 36, 361 };
+					break;
+				case OP_DRAW:
+					inst.command = { "draw", name };
+					inst.flags = { 10, 22 };
+					break;
+				default:
+					break;
+			}
+			result.push_back(inst);
+		}
+		return result;
+	}
+
+	//Save in binary format
+	bool save(std::string filename) const{
+		std::string data(PLAN_MAGIC);
+		appendU32(&data, PLAN_VERSION);
+		appendU32(&data, strings.size());
+		appendU32(&data, ops.size());
+		for(const std::string &s : strings){
+			appendU32(&data, s.length());
+			data += s;
+		}
+		for(const PlanOp &op : ops){
+			appendU32(&data, op.type);
+			appendU32(&data, op.layer);
+			appendU32(&data, op.source);
+			appendU32(&data, op.ints[0]);
+			appendU32(&data, op.ints[1]);
+			uint32_t value;
+			memcpy(&value, &op.value, sizeof(value));
+			appendU32(&data, value);
+			appendU32(&data, op.mode);
+		}
+		appendU32(&data, crc32(data.data(), data.size()));
+
+		std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+		if(!file.is_open()){
+			printf("Error: Unable to open %s\n", filename.c_str());
+			return false;
+		}
+		file.write(data.data(), data.size());
+		return file.good();
+	}
+
+	//Load from binary format in a single read, leaving the plan unchanged if the file is invalid
+	bool load(std::string filename){
+		std::ifstream file(filename, std::ios::binary | std::ios::ate);
+		if(!file.is_open()){
+			return false;
+		}
+		std::string data(file.tellg(), '\0');
+		file.seekg(0);
+		file.read(&data[0], data.size());
+		if(!file.good()){
+			printf("Error: Unable to read %s\n", filename.c_str());
+			return false;
+		}
+
+		//Header and checksum
+		size_t magicLength = strlen(PLAN_MAGIC);
+		if(data.size() < magicLength + 16 || data.compare(0, magicLength, PLAN_MAGIC) != 0){
+			printf("Error: %s is not a binary instruction list\n", filename.c_str());
+			return false;
+		}
+		size_t end = data.size() - 4;
+		if(readU32(data, end) != crc32(data.data(), end)){
+			printf("Error: %s failed its checksum\n", filename.c_str());
+			return false;
+		}
+		size_t pos = magicLength;
+		uint32_t version = readU32(data, pos);
+		uint32_t stringCount = readU32(data, pos + 4);
+		uint32_t opCount = readU32(data, pos + 8);
+		pos += 12;
+		if(version < 1 || version > PLAN_VERSION){
+			printf("Error: %s has unsupported version %u\n", filename.c_str(), version);
+			return false;
+		}
+
+		//Strings
+		InstructionPlan loaded;
+		for(uint32_t i = 0; i < stringCount; i++){
+			if(pos + 4 > end){ return loadError(filename); }
+			uint32_t length = readU32(data, pos);
+			pos += 4;
+			if(length > end - pos){ return loadError(filename); }
+			loaded.intern(data.substr(pos, length));
+			pos += length;
+		}
+		if(loaded.strings.size() != stringCount){ return loadError(filename); }
+
+		//Ops
+		size_t opSize = version == 1 ? 24 : 28;
+		if((end - pos) != (size_t)opCount * opSize){ return loadError(filename); }
+		for(uint32_t i = 0; i < opCount; i++){
+			PlanOp op;
+			op.type = readU32(data, pos);
+			op.layer = readU32(data, pos + 4);
+			op.source = readU32(data, pos + 8);
+			op.ints[0] = readU32(data, pos + 12);
+			op.ints[1] = readU32(data, pos + 16);
+			uint32_t value = readU32(data, pos + 20);
+			memcpy(&op.value, &value, sizeof(value));
+			op.mode = version == 1 ? 0 : readU32(data, pos + 24);
+			loaded.ops.push_back(op);
+			pos += opSize;
+		}
+
+		if(!loaded.validate()){
+			return loadError(filename);
+		}
+		*this = loaded;
+		return true;
+	}
+
+	//Returns whether every op is well formed and only uses Layers defined before it
+	bool validate() const{
+		std::vector<bool> defined(strings.size(), false);
+		for(int i = 0; i < ops.size(); i++){
+			const PlanOp &op = ops[i];
+			bool valid = op.type >= 0 && op.type < OP_COUNT && isStringIndex(op.layer);
+			if(valid){
+				switch(op.type){
+					case OP_LAYER_CAMERA:
+						defined[op.layer] = true;
+						break;
+					case OP_LAYER_IMAGE:
+					case OP_LAYER_SHARED:
+						valid = isStringIndex(op.source);
+						defined[op.layer] = true;
+						break;
+					case OP_RESIZE_DIMENSIONS:
+						valid = op.ints[0] > 0 && op.ints[1] > 0 && isFilter(op.mode);
+						break;
+					case OP_RESIZE_SCALE:
+						valid = op.value > 0 && isFilter(op.mode);
+						break;
+					case OP_ROTATE:
+						valid = op.mode == 0 || op.mode == 1;
+						break;
+					case OP_TEXT:
+					case OP_LUT:
+						valid = isStringIndex(op.source);
+						break;
+					case OP_OVERLAY:
+						valid = isStringIndex(op.source) && defined[op.source];
+						break;
+					case OP_KEY_CHROMA:
+						valid = op.ints[1] >= 0 && op.value >= 0;
+						break;
+					case OP_KEY_LUMA:
+						valid = op.ints[0] >= 0 && op.ints[0] <= 255 && op.ints[1] >= 0 && op.ints[1] <= 255;
+						break;
+					default:
+						break;
+				}
+				valid = valid && defined[op.layer];
+			}
+			if(!valid){
+				printf("Error: Invalid instruction %d in plan\n", i);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void clear(){
+		strings.clear();
+		stringIndex.clear();
+		ops.clear();
+	}
+
+	//Get methods
+	const std::vector<PlanOp> &getOps() const{
+		return ops;
+	}
+	const std::string &getString(int index) const{
+		return strings[index];
+	}
+	int getStringCount() const{
+		return strings.size();
+	}
+
+	//Returns the index of [s] in the string table, adding it if new
+	int intern(const std::string &s){
+		std::unordered_map<std::string, int>::iterator found = stringIndex.find(s);
+		if(found != stringIndex.end()){
+			return found->second;
+		}
+		strings.push_back(s);
+		stringIndex[s] = strings.size() - 1;
+		return strings.size() - 1;
+	}
+
+private:
+	//Compile a single Instruction, returns false if it was not recognized
+	bool compileInstruction(const Instruction &inst, PlanOp *op){
+		const std::vector<std::string> &c = inst.command;
+		if(c.size() < 2){
+			return false;
+		}
+		op->layer = intern(c[1]);
+		op->source = -1;
+		op->ints[0] = op->ints[1] = 0;
+		op->value = 0;
+		op->mode = 0;
+
+		//New Layer
+		if(hasFlag(inst, 20)){
+			if(hasFlag(inst, 201)){
+				op->type = OP_LAYER_CAMERA;
+				return true;
+			}
+			if(hasFlag(inst, 202) && c.size() >= 4){
+				op->type = OP_LAYER_IMAGE;
+				op->source = intern(c[3]);
+				return true;
+			}
+			if(hasFlag(inst, 203) && c.size() >= 4){
+				op->type = OP_LAYER_SHARED;
+				op->source = intern(c[3]);
+				return true;
+			}
+		}
+
+		//Process Layer
+		else if(hasFlag(inst, 21)){
+			//Resize arguments follow the filter, if one is given
+			op->mode = getFilter(inst, FILTER_NEAREST);
+			int f = op->mode != FILTER_NEAREST || hasFlag(inst, 591) ? 1 : 0;
+			if(hasFlag(inst, 300) && c.size() >= 6 + f){
+				op->type = OP_RESIZE_DIMENSIONS;
+				op->ints[0] = parseInteger(c[4 + f]);
+				op->ints[1] = parseInteger(c[5 + f]);
+				return true;
+			}
+			if(hasFlag(inst, 301) && c.size() >= 5 + f){
+				op->type = OP_RESIZE_SCALE;
+				op->value = parseFloat(c[4 + f]);
+				return true;
+			}
+			op->mode = 0;
+			if(hasFlag(inst, 31)){
+				op->mode = hasFlag(inst, 310) ? 1 : 0;
+				if(c.size() >= 4 + op->mode){
+					op->type = OP_ROTATE;
+					op->value = parseFloat(c[3 + op->mode]);
+					return true;
+				}
+				op->mode = 0;
+			}
+			if(hasFlag(inst, 320) && c.size() >= 5){
+				op->type = OP_ALPHA_FLAT;
+				op->value = parseFloat(c[4]);
+				return true;
+			}
+			if(hasFlag(inst, 321) && c.size() >= 6){
+				op->type = OP_ALPHA_CIRCULAR;
+				op->ints[0] = parseInteger(c[4]);
+				op->ints[1] = parseInteger(c[5]);
+				return true;
+			}
+			if(hasFlag(inst, 33) && c.size() >= 4){
+				op->type = OP_TEXT;
+				op->source = intern(joinWords(c, 3));
+				return true;
+			}
+			if(hasFlag(inst, 34) && c.size() >= 4){
+				op->type = OP_OVERLAY;
+				op->source = intern(c[3]);
+				return true;
+			}
+			if(hasFlag(inst, 35) && c.size() >= 4){
+				op->type = OP_LUT;
+				op->source = intern(c[3]);
+				return true;
+			}
+			if(hasFlag(inst, 360) && c.size() >= 7){
+				op->type = OP_KEY_CHROMA;
+				op->ints[0] = parseInteger(c[4]);
+				op->ints[1] = parseInteger(c[5]);
+				op->value = parseFloat(c[6]);
+				return true;
+			}
+			if(hasFlag(inst, 361) && c.size() >= 6){
+				op->type = OP_KEY_LUMA;
+				op->ints[0] = parseInteger(c[4]);
+				op->ints[1] = parseInteger(c[5]);
+				//Same range as a loaded plan, so the ramp fits the 16-bit lanes of applyKeyRow
+				if(op->ints[0] < 0 || op->ints[0] > 255 || op->ints[1] < 0 || op->ints[1] > 255){
+					printf("Error: Luma key values must be from 0 to 255\n");
+					return false;
+				}
+				return true;
+			}
+		}
+
+		//Draw Layer
+		else if(hasFlag(inst, 22)){
+			op->type = OP_DRAW;
+			return true;
+		}
+		return false;
+	}
+
+public:
+	//Returns the filter named by flags 591 to 594, [fallback] if none
+	static ResampleFilter getFilter(const Instruction &inst, ResampleFilter fallback){
+		for(int f = FILTER_NEAREST; f <= FILTER_LANCZOS; f++){
+			if(hasFlag(inst, 591 + f)){
+				return (ResampleFilter)f;
+			}
+		}
+		return fallback;
+	}
+
+private:
+	//Insert the filter of a resize before its size arguments, nearest is left implicit
+	static void addFilter(Instruction *inst, ResampleFilter filter){
+		if(filter != FILTER_NEAREST){
+			inst->command.insert(inst->command.begin() + 3, getFilterName(filter));
+			inst->flags.push_back(591 + filter);
+		}
+	}
+
+	static bool isFilter(int32_t mode){
+		return mode >= FILTER_NEAREST && mode <= FILTER_LANCZOS;
+	}
+
+	bool isStringIndex(int32_t index) const{
+		return index >= 0 && index < strings.size();
+	}
+
+	static bool hasFlag(const Instruction &inst, int query){
+		for(int f : inst.flags){
+			if(f == query){
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Join command words from [start], separated by spaces
+	static std::string joinWords(const std::vector<std::string> &words, int start){
+		std::string result = "";
+		for(int i = start; i < words.size(); i++){
+			result += words[i];
+			if(i != words.size() - 1){
+				result += " ";
+			}
+		}
+		return result;
+	}
+
+	//Shortest text that parses back to the same float
+	static std::string formatFloat(float value){
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%.9g", value);
+		for(int precision = 1; precision < 9; precision++){
+			char shorter[32];
+			snprintf(shorter, sizeof(shorter), "%.*g", precision, value);
+			if(strtof(shorter, NULL) == value){
+				return shorter;
+			}
+		}
+		return buffer;
+	}
+
+	static bool loadError(std::string filename){
+		printf("Error: %s is malformed\n", filename.c_str());
+		return false;
+	}
+
+	static void appendU32(std::string *data, uint32_t value){
+		for(int i = 0; i < 4; i++){
+			data->push_back((char)((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+	static uint32_t readU32(const std::string &data, size_t pos){
+		uint32_t value = 0;
+		for(int i = 0; i < 4; i++){
+			value |= (uint32_t)(unsigned char)data[pos + i] << (8 * i);
+		}
+		return value;
+	}
+
+	//Table-driven CRC-32 (IEEE)
+	static uint32_t crc32(const char *data, size_t length){
+		static const std::vector<uint32_t> table = buildCRCTable();
+		uint32_t crc = 0xFFFFFFFF;
+		for(size_t i = 0; i < length; i++){
+			crc = table[(crc ^ (unsigned char)data[i]) & 0xFF] ^ (crc >> 8);
+		}
+		return crc ^ 0xFFFFFFFF;
+	}
+
+	static std::vector<uint32_t> buildCRCTable(){
+		std::vector<uint32_t> table(256);
+		for(uint32_t i = 0; i < 256; i++){
+			uint32_t c = i;
+			for(int k = 0; k < 8; k++){
+				c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		return table;
+	}
+};
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <mutex>
+
+#include "helper.h"
+
+#define HISTOGRAM_BUCKETS 200 //1 ms buckets, last bucket collects everything above
+#define LATENCY_RECENT_WEIGHT 0.1 //Weight of each new measurement in the recent latency average
+
+//Thread-safe histogram of durations in milliseconds
+class Histogram{
+private:
+	long int buckets[HISTOGRAM_BUCKETS] = {};
+	long int count = 0;
+	double sum = 0, min = 0, max = 0;
+	std::mutex mut;
+
+public:
+	//Add a measurement
+	void record(double ms){
+		std::lock_guard<std::mutex> lock(mut);
+		int bucket = std::max(0, std::min((int)ms, HISTOGRAM_BUCKETS - 1));
+		buckets[bucket]++;
+		min = count == 0 ? ms : std::min(min, ms);
+		max = count == 0 ? ms : std::max(max, ms);
+		sum += ms;
+		count++;
+	}
+
+	//Remove all measurements
+	void reset(){
+		std::lock_guard<std::mutex> lock(mut);
+		std::fill(buckets, buckets + HISTOGRAM_BUCKETS, 0);
+		count = 0;
+		sum = min = max = 0;
+	}
+
+	//Return the upper bound of the bucket containing percentile [p], from 0 to 100
+	double percentile(double p){
+		std::lock_guard<std::mutex> lock(mut);
+		return percentileLocked(p);
+	}
+
+	//Print summary and a bar per 5 ms
+	void print(std::string title){
+		std::lock_guard<std::mutex> lock(mut);
+		printf("****************\n"
+		       "* %-12s *\n"
+		       "****************\n", title.c_str());
+		if(count == 0){
+			printf("No measurements\n"
+			       "****************\n");
+			return;
+		}
+		printf("Samples: %ld, Min: %.2f ms, Mean: %.2f ms, Max: %.2f ms\n", count, min, sum / count, max);
+		printf("p50: <%.0f ms, p95: <%.0f ms, p99: <%.0f ms\n", percentileLocked(50), percentileLocked(95), percentileLocked(99));
+		for(int b = 0; b < HISTOGRAM_BUCKETS; b += 5){
+			long int rowCount = 0;
+			for(int i = b; i < b + 5 && i < HISTOGRAM_BUCKETS; i++){
+				rowCount += buckets[i];
+			}
+			if(rowCount > 0){
+				int bar = std::max(1, (int)(40 * rowCount / count));
+				printf("%3d-%3d ms | %s %ld\n", b, b + 5, std::string(bar, '#').c_str(), rowCount);
+			}
+		}
+		printf("****************\n");
+	}
+
+	long int getCount(){
+		std::lock_guard<std::mutex> lock(mut);
+		return count;
+	}
+	double getMean(){
+		std::lock_guard<std::mutex> lock(mut);
+		return count == 0 ? 0 : sum / count;
+	}
+
+private:
+	double percentileLocked(double p){
+		long int target = (long int)(count * p / 100.0);
+		long int seen = 0;
+		for(int i = 0; i < HISTOGRAM_BUCKETS; i++){
+			seen += buckets[i];
+			if(seen > target){
+				return i + 1;
+			}
+		}
+		return HISTOGRAM_BUCKETS;
+	}
+};
+
+//Motion-to-photon latency, from camera capture to framebuffer write
+class LatencyMonitor{
+private:
+	Histogram histogram;
+	std::ofstream logFile;
+	std::mutex logMut;
+	long int frameNumber = 0;
+	double recent = 0; //Moving average, for live readouts
+
+public:
+	//Record latency of a frame captured at [captured] and written at [written]
+	void record(Timestamp captured, Timestamp written){
+		double ms = getMilliseconds(captured, written);
+		histogram.record(ms);
+
+		std::lock_guard<std::mutex> lock(logMut);
+		recent = frameNumber == 0 ? ms : recent + (ms - recent) * LATENCY_RECENT_WEIGHT;
+		frameNumber++;
+		if(logFile.is_open()){
+			logFile << frameNumber << " " << ms << '\n';
+		}
+	}
+
+	//Log every measurement to [filename], or stop logging if empty
+	void setLogFile(std::string filename){
+		std::lock_guard<std::mutex> lock(logMut);
+		if(logFile.is_open()){
+			logFile.close();
+		}
+		if(filename == ""){
+			printf("Latency logging stopped\n");
+			return;
+		}
+		logFile.open(filename);
+		if(!logFile.is_open()){
+			printf("Error: Unable to open latency log %s\n", filename.c_str());
+			return;
+		}
+		logFile << "#frame latency_ms\n";
+		printf("Logging latency to %s\n", filename.c_str());
+	}
+
+	void print(){
+		histogram.print("LATENCY");
+	}
+	void reset(){
+		histogram.reset();
+	}
+	double getMean(){
+		return histogram.getMean();
+	}
+	double percentile(double p){
+		return histogram.percentile(p);
+	}
+	double getRecent(){
+		std::lock_guard<std::mutex> lock(logMut);
+		return recent;
+	}
+};
+
+#endif
@@ -4,18 +4,48 @@
 #include <opencv2/imgproc.hpp>
 #include <opencv2/core.hpp>
 #include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
 #include <cmath>
 
 #define SIMD_OPENCV_ENABLE
 #include "Simd/SimdLib.hpp"
 
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "colorLut.h"
+#include "colorKey.h"
+#include "resample.h"
+#include "rotate.h"
 #include "text.h"
 #include "helper.h"
 
+//Runs of opaque or partially transparent pixels in each row of an image, fully transparent pixels are left out
+struct AlphaSpans{
+	struct Span{
+		int start, end; //Columns [start, end)
+		bool opaque;
+	};
+	std::vector<Span> spans;
+	std::vector<int> rowStart; //Index of the first Span of each row, with one past the last row at the end
+};
+
 class Layer{
 private:
 	cv::Mat image;
 	std::string name = "";
+	Timestamp timestamp; //Capture time of the oldest source, epoch if none
+	bool premultiplied = false; //Color is stored multiplied by alpha
+	bool opaque = false;        //Every alpha is known to be 255
+	std::shared_ptr<const AlphaSpans> spans; //Shared by copies, dropped when the pixels change
+	bool borrowed = false;      //Pixels belong to someone else, and are copied before they are changed
+
+	//When only part of the Layer is kept, the image is the region at origin within a Layer of fullSize
+	cv::Point origin;
+	cv::Size fullSize;
 public:
 	Layer() {}
 	Layer(cv::Mat i){
@@ -24,21 +54,78 @@ public:
 	Layer(cv::Size size, cv::Vec4b color){
 		cv::Mat i(size, CV_8UC4, color);
 		setImage(i);
+		opaque = color[3] == 255;
+	}
+
+	//Wrap BGRA pixels owned by someone else, straight alpha unless [isPremultiplied], without copying them.
+	//The pixels are only copied if the Layer is changed in place
+	static Layer borrow(cv::Mat i, bool isOpaque, bool isPremultiplied=false){
+		Layer result;
+		result.image = i;
+		result.opaque = isOpaque;
+		result.premultiplied = isPremultiplied;
+		result.borrowed = true;
+		return result;
 	}
 
 	//Return copy of Layer
 	Layer copy(){
 		Layer result;
-		result.setImage(image);
+		result.setImage(image.clone());
 		result.setName(name);
+		result.setTimestamp(timestamp);
+		result.premultiplied = premultiplied;
+		result.opaque = opaque;
+		result.spans = spans;
+		result.origin = origin;
+		result.fullSize = fullSize;
 		return result;
 	}
 
-	//Overlay with Layer
+	//Return a Layer sharing this one's pixels, which are copied only if it is changed in place
+	Layer share(){
+		Layer result = *this;
+		result.borrowed = true;
+		return result;
+	}
+
+	//Return a Layer keeping only [region] of this one, sharing its pixels
+	Layer getRegion(cv::Rect region){
+		Layer result = *this;
+		region &= cv::Rect(0, 0, image.cols, image.rows);
+		if(region.size() == cv::Size(image.cols, image.rows)){
+			return result;
+		}
+		result.image = image(region);
+		result.spans.reset();
+		result.origin = origin + region.tl();
+		result.fullSize = getFullSize();
+		return result;
+	}
+
+	//Mark the image as the region at [o] of a Layer of size [full]
+	void setRegion(cv::Point o, cv::Size full){
+		origin = o;
+		fullSize = full;
+	}
+
+	//Overlay with Layer, centered
 	void overlay(Layer top){
-		overlay(top, (image.cols - top.getWidth()) / 2, (image.rows - top.getHeight()) / 2);
+		cv::Size full = getFullSize(), topFull = top.getFullSize();
+		overlay(top, (full.width - topFull.width) / 2, (full.height - topFull.height) / 2);
 	}
-	void overlay(Layer top, int top_x_offset, int top_y_offset){
+
+	//Overlay with Layer, placing its top left corner at ([top_x], [top_y])
+	void overlay(Layer top, int top_x, int top_y){
+		//Keep the capture time of the oldest source
+		if(top.hasTimestamp() && (!hasTimestamp() || top.getTimestamp() < timestamp)){
+			timestamp = top.getTimestamp();
+		}
+
+		//Position of the top image within this image, either may be a region
+		int top_x_offset = top_x + top.origin.x - origin.x;
+		int top_y_offset = top_y + top.origin.y - origin.y;
+
 		//Calculate variables
 		int y_start = std::max(0, top_y_offset);
 		int x_start = std::max(0, top_x_offset);
@@ -48,45 +135,253 @@ public:
 		int width = x_end - x_start;
 		int height = y_end - y_start;
 
-		if(width >= 0 && height >= 0){
-			cv::Mat alpha;
-	
-			//Create Regions of Interest
-			Simd::View<Simd::Allocator> vw_bot = image(cv::Rect(x_start, y_start, width, height));
-			Simd::View<Simd::Allocator> vw_top = top.getImage()(cv::Rect(x_start-top_x_offset, y_start-top_y_offset, width, height));
-	
-			//Extract Alpha channel
-			cv::extractChannel((cv::Mat)vw_top, alpha, 3);
-			
-			//Blend Alpha
-			Simd::AlphaBlending(vw_top, (Simd::View<Simd::Allocator>)alpha, vw_bot);
+		if(width <= 0 || height <= 0){
+			return;
+		}
+		makeWritable();
+		spans.reset();
+		cv::Mat roi_bot = image(cv::Rect(x_start, y_start, width, height));
+		cv::Mat roi_top = top.getImage()(cv::Rect(x_start-top_x_offset, y_start-top_y_offset, width, height));
+
+		//Opaque Layers replace what is below them
+		if(top.isOpaque()){
+			roi_top.copyTo(roi_bot);
+			return;
+		}
+
+		//Premultiplied Layers blend with the "over" operator. A straight top is premultiplied as it is blended,
+		//so it isn't copied
+		if(premultiplied || top.isPremultiplied()){
+			premultiply();
+			bool straight = !top.isPremultiplied();
+			if(top.hasSpans()){
+				blendOverSpans(top, x_start-top_x_offset, y_start-top_y_offset, roi_bot, straight);
+			}
+			else{
+				blendOver(roi_top, roi_bot, straight);
+			}
+			return;
+		}
+
+		//Straight alpha
+		cv::Mat alpha;
+
+		//Create Regions of Interest
+		Simd::View<Simd::Allocator> vw_bot = roi_bot;
+		Simd::View<Simd::Allocator> vw_top = roi_top;
+
+		//Extract Alpha channel
+		cv::extractChannel(roi_top, alpha, 3);
+
+		//Blend Alpha
+		Simd::AlphaBlending(vw_top, (Simd::View<Simd::Allocator>)alpha, vw_bot);
+		opaque = false;
+	}
+
+	//Blend [top] over premultiplied [bot]: bot = top + bot * (255 - top alpha) / 255, premultiplying the color
+	//of [top] first if it is [straight]
+	static void blendOver(const cv::Mat &top, cv::Mat &bot, bool straight){
+		for(int y = 0; y < top.rows; y++){
+			blendOverRow(top.ptr(y), bot.ptr(y), top.cols, straight);
+		}
+	}
+
+	//Blend the region of [top] starting at ([x_top], [y_top]) over [bot] using its spans.
+	//Transparent runs are skipped, opaque runs copied and only partial runs blended
+	static void blendOverSpans(Layer &top, int x_top, int y_top, cv::Mat &bot, bool straight){
+		const AlphaSpans &s = *top.spans;
+		cv::Mat image = top.getImage();
+		for(int y = 0; y < bot.rows; y++){
+			const uchar *t = image.ptr(y + y_top);
+			uchar *b = bot.ptr(y);
+			for(int i = s.rowStart[y + y_top]; i < s.rowStart[y + y_top + 1]; i++){
+				int start = std::max(s.spans[i].start, x_top);
+				int end = std::min(s.spans[i].end, x_top + bot.cols);
+				if(start >= end){
+					continue;
+				}
+				if(s.spans[i].opaque){
+					memcpy(b + (start - x_top) * 4, t + start * 4, (end - start) * 4);
+				}
+				else{
+					blendOverRow(t + start * 4, b + (start - x_top) * 4, end - start, straight);
+				}
+			}
+		}
+	}
+
+	static void blendOverRow(const uchar *t, uchar *b, int count, bool straight){
+		if(straight){
+			blendOverRow<true>(t, b, count);
+		}
+		else{
+			blendOverRow<false>(t, b, count);
 		}
 	}
 
+	template<bool STRAIGHT>
+	static void blendOverRow(const uchar *t, uchar *b, int count){
+		int x = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+		//8 pixels at a time, split into channels. Rounded division by 255 as in divide255, saturating add as in std::min
+		for(; x + 32 <= count * 4; x += 32){
+			uint8x8x4_t top = vld4_u8(t + x);
+			uint8x8x4_t bot = vld4_u8(b + x);
+			uint8x8_t inverse = vmvn_u8(top.val[3]);
+			for(int c = 0; c < 4; c++){
+				if(STRAIGHT && c < 3){
+					uint16x8_t color = vmull_u8(top.val[c], top.val[3]);
+					top.val[c] = vraddhn_u16(color, vrshrq_n_u16(color, 8));
+				}
+				uint16x8_t product = vmull_u8(bot.val[c], inverse);
+				bot.val[c] = vqadd_u8(top.val[c], vraddhn_u16(product, vrshrq_n_u16(product, 8)));
+			}
+			vst4_u8(b + x, bot);
+		}
+#endif
+		for(; x < count * 4; x += 4){
+			int inverse = 255 - t[x + 3];
+			for(int c = 0; c < 4; c++){
+				int color = STRAIGHT && c < 3 ? divide255(t[x + c] * t[x + 3]) : t[x + c];
+				b[x + c] = std::min(255, color + divide255(b[x + c] * inverse));
+			}
+		}
+	}
+
+	//Find the opaque and partially transparent runs of every row, for Layers overlaid many times
+	void analyzeSpans(){
+		std::shared_ptr<AlphaSpans> result = std::make_shared<AlphaSpans>();
+		for(int y = 0; y < image.rows; y++){
+			result->rowStart.push_back(result->spans.size());
+			const uchar *p = image.ptr(y);
+			int x = 0;
+			while(x < image.cols){
+				uchar a = p[x * 4 + 3];
+				if(a == 0){
+					x++;
+					continue;
+				}
+				AlphaSpans::Span span;
+				span.start = x;
+				span.opaque = a == 255;
+				while(x < image.cols && p[x * 4 + 3] != 0 && (p[x * 4 + 3] == 255) == span.opaque){
+					x++;
+				}
+				span.end = x;
+				result->spans.push_back(span);
+			}
+		}
+		result->rowStart.push_back(result->spans.size());
+		spans = result;
+	}
+
+	//Rounded division by 255 of a product of two 8-bit values
+	static inline int divide255(int v){
+		v += 128;
+		return (v + (v >> 8)) >> 8;
+	}
+
+	//Multiply color by alpha, once per Layer
+	void premultiply(){
+		if(premultiplied || image.empty()){
+			premultiplied = true;
+			return;
+		}
+		premultiplied = true;
+		if(opaque){
+			return;
+		}
+		makeWritable();
+		Simd::View<Simd::Allocator> view = image;
+		Simd::AlphaPremultiply(view, view);
+	}
+
+	//Return to straight alpha, before changing alpha
+	void unpremultiply(){
+		if(!premultiplied){
+			return;
+		}
+		premultiplied = false;
+		if(opaque){
+			return;
+		}
+		makeWritable();
+		for(int y = 0; y < image.rows; y++){
+			uchar *p = image.ptr(y);
+			for(int x = 0; x < image.cols * 4; x += 4){
+				int a = p[x + 3];
+				for(int c = 0; c < 3; c++){
+					p[x + c] = a == 0 ? 0 : std::min(255, (p[x + c] * 255 + a / 2) / a);
+				}
+			}
+		}
+	}
+
+	//Check every alpha, marking the Layer opaque if all are 255
+	bool detectOpaque(){
+		opaque = !image.empty();
+		for(int y = 0; y < image.rows && opaque; y++){
+			const uchar *p = image.ptr(y);
+			for(int x = 3; x < image.cols * 4; x += 4){
+				if(p[x] != 255){
+					opaque = false;
+					break;
+				}
+			}
+		}
+		return opaque;
+	}
+
 	//Add text, centered on the screen
 	void overlayText(std::string message, Text text){
-		cv::Mat messageImage = text.getText(message);
-		float fontScalar = text.getStyling().fontSize;
-		resize(messageImage, messageImage, cv::Size(), fontScalar, fontScalar, cv::INTER_NEAREST);
-		overlay(Layer(messageImage));
+		overlay(getTextLayer(message, text));
 	}
 
 	//Add text, at coordinates
 	void overlayText(std::string message, Text text, int x, int y){
-		cv::Mat messageImage = text.getText(message);
+		overlay(getTextLayer(message, text), x, y);
+	}
+
+	//Render text at its font size, premultiplied by the Text
+	static Layer getTextLayer(std::string message, Text text){
+		cv::Mat messageImage = text.getText(message, true);
 		float fontScalar = text.getStyling().fontSize;
 		resize(messageImage, messageImage, cv::Size(), fontScalar, fontScalar, cv::INTER_NEAREST);
-		overlay(Layer(messageImage), x, y);
+		Layer result(messageImage);
+		result.premultiplied = true;
+		return result;
 	}
 
 	//Resize Layer by dimensions
-	void resizeLayer(int x_dim, int y_dim){
-		resize(image, image, cv::Size(x_dim, y_dim), cv::INTER_NEAREST);
+	void resizeLayer(int x_dim, int y_dim, ResampleFilter filter=FILTER_NEAREST){
+		//Already the size, so the spans and borrowed pixels stay valid
+		if(cv::Size(x_dim, y_dim) == getFullSize()){
+			return;
+		}
+		spans.reset();
+		const uchar *pixels = image.data;
+		if(fullSize.area() == 0){
+			resample(image, image, cv::Size(x_dim, y_dim), filter);
+		}
+		else{
+			//Resize the kept region as part of the full Layer, so it matches the same region of the full Layer resized
+			double sx = (double)x_dim / fullSize.width, sy = (double)y_dim / fullSize.height;
+			cv::Point start(cvRound(origin.x * sx), cvRound(origin.y * sy));
+			cv::Point end(cvRound((origin.x + image.cols) * sx), cvRound((origin.y + image.rows) * sy));
+			cv::Rect region(start, cv::Size(std::max(1, end.x - start.x), std::max(1, end.y - start.y)));
+			resample(image, origin, fullSize, image, region, cv::Size(x_dim, y_dim), filter);
+			origin = start;
+			fullSize = cv::Size(x_dim, y_dim);
+		}
+
+		//Resampled pixels are new, and no longer borrowed
+		borrowed = borrowed && image.data == pixels;
 	}
 
 	//Resize Layer by scale
-	void resizeLayer(float scale){
-		resize(image, image, cv::Size(), scale, scale, cv::INTER_NEAREST);
+	void resizeLayer(float scale, ResampleFilter filter=FILTER_NEAREST){
+		cv::Size full = getFullSize();
+		resizeLayer(cvRound(full.width * scale), cvRound(full.height * scale), filter);
 	}
 
 	//Crop Layer in center
@@ -98,27 +393,61 @@ public:
 
 	//Crop Layer at given coordinates
 	void cropLayer(int x, int y, int width, int height){
+		spans.reset();
 		cv::Mat temp = image(cv::Rect(x, y, width, height));
 		temp.copyTo(image);
 	}
 
-	//Rotate Layer
-	void rotateLayer(int angle){
-		//Get center of image
-		cv::Point2f centerPoint((image.cols - 1) / 2.0, (image.rows - 1) / 2.0);
+	//Rotate Layer counter-clockwise by [angle] degrees, expanding to fit the rotated image if [expand].
+	//Rotation needs the full Layer, so it is never given one with only a region kept
+	void rotateLayer(float angle, bool expand=false){
+		bool covered = rotateImage(image, image, angle, expand);
+		opaque = opaque && covered;
+		spans.reset();
+	}
 
-		//Calculate rotation matrix
-		cv::Mat rotation_mat = cv::getRotationMatrix2D(centerPoint, angle, 1.0);
+	//Grade color with [lut], on straight alpha so partially transparent edges keep their hue
+	void applyLut(const ColorLut &lut){
+		if(lut.identity){
+			return;
+		}
+		unpremultiply();
+		makeWritable();
+		applyColorLut(image, lut);
+	}
 
-		//Apply rotation matrix
-		cv::warpAffine(image, image, rotation_mat, image.size());
+	//Make colors matching a chroma or luma key transparent, multiplying the existing alpha
+	void applyKey(const KeyTable &table){
+		unpremultiply();
+		makeWritable();
+		applyKeyTable(image, table, opaque);
+		opaque = false;
+		spans.reset();
 	}
 
+	//Copy of the alpha channel
+	cv::Mat getAlphaChannel(){
+		cv::Mat alpha;
+		cv::extractChannel(image, alpha, 3);
+		return alpha;
+	}
 
+	//Replace the alpha channel with [alpha], the same size as the image
+	void setAlphaChannel(const cv::Mat &alpha){
+		unpremultiply();
+		makeWritable();
+		cv::insertChannel(alpha, image, 3);
+		opaque = false;
+		spans.reset();
+	}
 
 	//Set flat alpha value across image
 	void setAlpha(float val){
+		unpremultiply();
+		makeWritable();
+		spans.reset();
 		int alphaVal = 255.0 * val;
+		opaque = alphaVal >= 255;
 		for(int y = 0; y < image.rows; y++){
 			for(int x = 0; x < image.cols; x++){
 				image.at<cv::Vec4b>(y, x)[3] = alphaVal;
@@ -128,8 +457,13 @@ public:
 
 	//Set alpha in circular pattern
 	void setAlphaPattern_Circular(int inner, int outer, bool middle=true, int min_alpha=0, int max_alpha=255){
-		int yCenter = image.rows / 2;
-		int xCenter = image.cols / 2;
+		unpremultiply();
+		makeWritable();
+		opaque = false;
+		spans.reset();
+		cv::Size full = getFullSize();
+		int yCenter = full.height / 2 - origin.y;
+		int xCenter = full.width / 2 - origin.x;
 		for(int y = 0; y < image.rows; y++){
 			for(int x = 0; x < image.cols; x++){
 				float distFromCenter = sqrt(pow(x-xCenter, 2) + pow(y-yCenter, 2));
@@ -141,26 +475,82 @@ public:
 	}
 
 	//Get / Set functions
+	//Set straight alpha image, a Layer without an alpha channel is opaque
 	void setImage(cv::Mat i){
-		cv::cvtColor(i, image, cv::COLOR_BGR2BGRA);
+		premultiplied = false;
+		borrowed = false;
+		opaque = i.channels() != 4;
+		spans.reset();
+		origin = cv::Point();
+		fullSize = cv::Size();
+		if(i.channels() == 4){
+			image = i;
+		}
+		else if(i.channels() == 1){
+			cv::cvtColor(i, image, cv::COLOR_GRAY2BGRA);
+		}
+		else{
+			cv::cvtColor(i, image, cv::COLOR_BGR2BGRA);
+		}
 	}
 	cv::Mat getImage(){
 		return image;
 	}
 
-	void setName(std::string n){
+	void setName(const std::string &n){
 		name = n;
 	}
-	std::string getName(){
+	const std::string &getName() const{
 		return name;
 	}
 
+	void setTimestamp(Timestamp t){
+		timestamp = t;
+	}
+	Timestamp getTimestamp(){
+		return timestamp;
+	}
+	bool hasTimestamp(){
+		return timestamp != Timestamp();
+	}
+
+	void setOpaque(bool o){
+		opaque = o;
+	}
+	bool isOpaque(){
+		return opaque;
+	}
+	bool isPremultiplied(){
+		return premultiplied;
+	}
+	bool hasSpans(){
+		return spans != nullptr;
+	}
+
+	//Position of the image within the full Layer
+	cv::Point getOrigin(){
+		return origin;
+	}
+
+	//Size of the full Layer, which is larger than the image if only a region is kept
+	cv::Size getFullSize(){
+		return fullSize.area() > 0 ? fullSize : cv::Size(image.cols, image.rows);
+	}
+
 	int getHeight(){
 		return image.rows;
 	}
 	int getWidth(){
 		return image.cols;
 	}
+
+	//Copy borrowed pixels, before changing them in place
+	void makeWritable(){
+		if(borrowed){
+			image = image.clone();
+			borrowed = false;
+		}
+	}
 };
 
 #endif
@@ -0,0 +1,78 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+
+#include "helper.h"
+
+//Startup options, read from the command line
+struct LaunchOptions{
+	bool headless = false;         //Render to memory instead of the framebuffers
+	std::string headlessDir = "";  //Map headless outputs to raw files in this directory
+	int pngInterval = 0;           //Write a headless PNG every N frames
+	long int frames = -1;          //Exit after N frames, printing throughput
+	int cameraID = 0;              //Camera device, negative for none
+	std::string script = "";       //Script to run at startup
+	std::string realtime = "";     //Real-time scheduling settings to load at startup
+	std::vector<std::string> outputs; //Additional framebuffer devices, or headless output names
+};
+
+void displayUsageMessage(){
+	printf("Usage: viveToPi [OPTIONS]\n"
+	       "  --headless           Render to memory instead of /dev/fb0 and /dev/fb1\n"
+	       "  --headless-dir [DIR] Render to raw files vive.raw and monitor.raw in [DIR]\n"
+	       "  --png [INT]          Write headless outputs to PNG every [INT] frames\n"
+	       "  --frames [INT]       Render [INT] frames without a terminal, then exit\n"
+	       "  --camera [INT]       Camera device ID, -1 to use a test pattern\n"
+	       "  --script [FILE]      Run the terminal commands in [FILE] at startup\n"
+	       "  --output [DEV]       Mirror to framebuffer [DEV] as well, may be repeated\n"
+	       "  --realtime [FILE]    Load thread scheduling and memory locking from [FILE]\n");
+}
+
+//Parse command line, returns false on invalid input
+bool parseOptions(int argc, char **argv, LaunchOptions *options){
+	for(int i = 1; i < argc; i++){
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+
+		if(arg == "--headless"){
+			options->headless = true;
+		}
+		else if(arg == "--headless-dir" && hasValue){
+			options->headless = true;
+			options->headlessDir = argv[++i];
+		}
+		else if(arg == "--png" && hasValue && canParseInteger(argv[i+1])){
+			options->pngInterval = parseInteger(argv[++i]);
+		}
+		else if(arg == "--frames" && hasValue && canParseInteger(argv[i+1])){
+			options->frames = parseInteger(argv[++i]);
+			//Without a terminal, a count that is never reached could only be stopped with a signal
+			if(options->frames <= 0){
+				displayInvalidMessage("Frame count must be positive");
+				return false;
+			}
+		}
+		else if(arg == "--output" && hasValue){
+			options->outputs.push_back(argv[++i]);
+		}
+		else if(arg == "--realtime" && hasValue){
+			options->realtime = argv[++i];
+		}
+		else if(arg == "--script" && hasValue){
+			options->script = argv[++i];
+		}
+		else if(arg == "--camera" && hasValue && canParseInteger(argv[i+1])){
+			options->cameraID = parseInteger(argv[++i]);
+		}
+		else{
+			displayInvalidMessage("Unrecognized option: " + arg);
+			displayUsageMessage();
+			return false;
+		}
+	}
+	return true;
+}
+
+#endif
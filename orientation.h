@@ -0,0 +1,103 @@
+#ifndef ORIENTATION_H
+#define ORIENTATION_H
+
+#include <algorithm>
+#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "helper.h"
+
+//Head orientation in degrees
+struct Orientation{
+	float yaw = 0;
+	float pitch = 0;
+	float roll = 0;
+};
+
+//Source of head orientation, sampled by the presenter to correct reused frames
+class OrientationSource{
+public:
+	virtual ~OrientationSource() {}
+	virtual Orientation getOrientation(Timestamp t) = 0;
+};
+
+//Orientation that never changes, used when no tracking is available
+class FixedOrientationSource : public OrientationSource{
+public:
+	Orientation getOrientation(Timestamp t){
+		return Orientation();
+	}
+};
+
+//Orientation replayed from a file of "SECONDS YAW PITCH ROLL" lines, looping at the end
+class ReplayOrientationSource : public OrientationSource{
+private:
+	std::vector<double> times;
+	std::vector<Orientation> samples;
+	Timestamp start;
+
+public:
+	ReplayOrientationSource(std::string filename){
+		start = getMonotonicTime();
+
+		std::ifstream file(filename);
+		if(!file.is_open()){
+			printf("Error: Unable to open orientation file %s\n", filename.c_str());
+			return;
+		}
+		std::string line;
+		while(getline(file, line)){
+			if(line == "" || line[0] == '#'){
+				continue;
+			}
+			std::vector<std::string> words = splitString(line, " ");
+			if(words.size() < 4 || !canParseFloat(words[0]) || !canParseFloat(words[1]) ||
+			   !canParseFloat(words[2]) || !canParseFloat(words[3])){
+				printf("Error: Invalid orientation sample: %s\n", line.c_str());
+				continue;
+			}
+			double t = parseFloat(words[0]);
+			if(!times.empty() && t <= times.back()){
+				printf("Error: Orientation samples out of order: %s\n", line.c_str());
+				continue;
+			}
+			Orientation o;
+			o.yaw = parseFloat(words[1]);
+			o.pitch = parseFloat(words[2]);
+			o.roll = parseFloat(words[3]);
+			times.push_back(t);
+			samples.push_back(o);
+		}
+		printf("Read %d orientation samples from %s\n", (int)samples.size(), filename.c_str());
+	}
+
+	//Linearly interpolate between the samples surrounding [t]
+	Orientation getOrientation(Timestamp t){
+		if(samples.empty()){
+			return Orientation();
+		}
+		double duration = times.back();
+		double seconds = getMilliseconds(start, t) / 1000.0;
+		if(duration > 0){
+			seconds = seconds - duration * std::floor(seconds / duration);
+		}
+
+		int next = std::upper_bound(times.begin(), times.end(), seconds) - times.begin();
+		if(next == 0){
+			return samples.front();
+		}
+		if(next == times.size()){
+			return samples.back();
+		}
+		float a = (seconds - times[next - 1]) / (times[next] - times[next - 1]);
+		Orientation result;
+		result.yaw = samples[next - 1].yaw + a * (samples[next].yaw - samples[next - 1].yaw);
+		result.pitch = samples[next - 1].pitch + a * (samples[next].pitch - samples[next - 1].pitch);
+		result.roll = samples[next - 1].roll + a * (samples[next].roll - samples[next - 1].roll);
+		return result;
+	}
+};
+
+#endif
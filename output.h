@@ -0,0 +1,34 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <opencv2/core.hpp>
+
+//Video output target, implemented by Framebuffer and HeadlessOutput
+class Output{
+public:
+	virtual ~Output() {}
+
+	//Place row of color data
+	virtual void putRow(uchar* row, int x, int y, size_t size) = 0;
+
+	//Called once every row of a frame has been placed
+	virtual void present() {}
+
+	//Get resolution
+	virtual int getXRes() = 0;
+	virtual int getYRes() = 0;
+
+	//Bits per pixel of placed rows, 32 for BGRA or 16 for BGR565
+	virtual int getBitsPerPixel() { return 32; }
+
+	//Touch every page of the output's memory, so the first frames don't page fault
+	virtual void prefault() {}
+
+	//Returns whether the output was successfully opened
+	virtual bool isOpen() = 0;
+
+	//Release output
+	virtual void closeOutput() = 0;
+};
+
+#endif
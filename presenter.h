@@ -0,0 +1,237 @@
+#ifndef PRESENTER_H
+#define PRESENTER_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core.hpp>
+#include <condition_variable>
+#include <functional>
+#include <cstring>
+#include <deque>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <cmath>
+
+#include "orientation.h"
+#include "realtime.h"
+#include "helper.h"
+
+#define PIXELS_PER_DEGREE 9.8 //Vive eye width over horizontal field of view, 1080 / 110
+#define PRESENT_QUEUE 3       //Composites waiting to be written without a rate, before submitting waits
+
+//Presents the newest finished composite on its own thread, either at a steady display rate or as soon as each
+//one is submitted. At a display rate, when no new composite is ready, the last one is reprojected to the current orientation
+class Presenter{
+public:
+	//Writes a frame to the output, with the capture time of a new frame or epoch for a reprojected one
+	typedef std::function<void(cv::Mat, Timestamp)> WriteFunction;
+
+private:
+	WriteFunction write;
+	std::shared_ptr<OrientationSource> source;
+
+	//Newest composite, guarded by mut
+	std::mutex mut;
+	std::condition_variable submitted;
+	cv::Mat latest;
+	Timestamp latestCaptured;
+	Orientation latestOrientation;
+	long int latestNumber = 0;
+
+	//Without a rate, every composite is queued and written in order, guarded by mut
+	struct Pending{
+		cv::Mat composite;
+		Timestamp captured;
+	};
+	std::deque<Pending> queue;
+	std::condition_variable written;
+
+	std::thread thread;
+	std::atomic<bool> running;
+	std::atomic<bool> reproject;
+	double rate = 60;
+
+	cv::Mat warped;
+
+public:
+	Presenter(){
+		running = false;
+		reproject = true;
+		source = std::make_shared<FixedOrientationSource>();
+	}
+	~Presenter(){
+		stop();
+	}
+
+	//Start presenting at [displayRate] frames per second, or every composite as it is submitted if 0
+	void start(WriteFunction w, double displayRate){
+		stop();
+		write = w;
+		rate = displayRate;
+		queue.clear();
+		running = true;
+		thread = std::thread(&Presenter::presentThread, this);
+	}
+
+	//Stop presenting, waiting for the thread to write every queued composite and finish
+	void stop(){
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			running = false;
+		}
+		submitted.notify_all();
+		written.notify_all();
+		if(thread.joinable()){
+			thread.join();
+		}
+	}
+
+	//Hand a finished composite to the presenter. The composite must not be modified afterwards.
+	//Without a rate, waits while PRESENT_QUEUE composites are still to be written, so none are dropped
+	void submit(cv::Mat composite, Timestamp captured){
+		if(rate <= 0){
+			std::unique_lock<std::mutex> lock(mut);
+			written.wait(lock, [&](){ return !running || queue.size() < PRESENT_QUEUE; });
+			if(running){
+				queue.push_back(Pending{ composite, captured });
+				submitted.notify_one();
+			}
+			return;
+		}
+		Orientation o = getSourceOrientation(captured == Timestamp() ? getMonotonicTime() : captured);
+		std::lock_guard<std::mutex> lock(mut);
+		latest = composite;
+		latestCaptured = captured;
+		latestOrientation = o;
+		latestNumber++;
+		submitted.notify_one();
+	}
+
+	//Set orientation source used for reprojection
+	void setOrientationSource(std::shared_ptr<OrientationSource> s){
+		std::lock_guard<std::mutex> lock(mut);
+		source = s;
+	}
+
+	//Enable or disable reprojection of reused frames
+	void setReprojection(bool r){
+		reproject = r;
+	}
+
+	bool isRunning(){
+		return running;
+	}
+	double getRate(){
+		return rate;
+	}
+
+private:
+	//Present thread function
+	void presentThread(){
+		RealtimeThread realtime("presenter");
+		long int shownNumber = 0;
+
+		//Without a rate, write every composite in order, and the ones still queued when stopped
+		if(rate <= 0){
+			while(true){
+				Pending next;
+				{
+					std::unique_lock<std::mutex> lock(mut);
+					submitted.wait(lock, [&](){ return !running || !queue.empty(); });
+					if(queue.empty()){
+						return;
+					}
+					next = queue.front();
+					queue.pop_front();
+				}
+				written.notify_one();
+				write(next.composite, next.captured);
+			}
+		}
+
+		std::chrono::duration<double> period(1.0 / rate);
+		Timestamp next = getMonotonicTime();
+
+		while(running){
+			cv::Mat frame;
+			Timestamp captured;
+			Orientation rendered;
+			long int number;
+			{
+				std::lock_guard<std::mutex> lock(mut);
+				frame = latest;
+				captured = latestCaptured;
+				rendered = latestOrientation;
+				number = latestNumber;
+			}
+
+			if(!frame.empty()){
+				//New composite
+				if(number != shownNumber){
+					write(frame, captured);
+					shownNumber = number;
+				}
+				//Reuse last composite, corrected to the current orientation
+				else if(reproject){
+					Orientation now = getSourceOrientation(getMonotonicTime());
+					if(reprojectFrame(frame, rendered, now)){
+						write(warped, Timestamp());
+					}
+				}
+			}
+
+			next += std::chrono::duration_cast<Timestamp::duration>(period);
+			Timestamp current = getMonotonicTime();
+			if(next < current){
+				next = current;
+			}
+			std::this_thread::sleep_until(next);
+		}
+	}
+
+	//Shift and rotate [frame] by the orientation change into warped, returns false if there is no change
+	bool reprojectFrame(cv::Mat frame, Orientation rendered, Orientation now){
+		int dx = (int)std::lround((rendered.yaw - now.yaw) * PIXELS_PER_DEGREE);
+		int dy = (int)std::lround((now.pitch - rendered.pitch) * PIXELS_PER_DEGREE);
+		float droll = now.roll - rendered.roll;
+
+		if(dx == 0 && dy == 0 && std::abs(droll) < 0.05){
+			return false;
+		}
+
+		//Rotation, shift and roll in one nearest-neighbour warp
+		if(std::abs(droll) >= 0.05){
+			cv::Point2f center((frame.cols - 1) / 2.0, (frame.rows - 1) / 2.0);
+			cv::Mat transform = cv::getRotationMatrix2D(center, droll, 1.0);
+			transform.at<double>(0, 2) += dx;
+			transform.at<double>(1, 2) += dy;
+			cv::warpAffine(frame, warped, transform, frame.size(), cv::INTER_NEAREST, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 255));
+			return true;
+		}
+
+		//Shift only, copied row by row
+		warped.create(frame.size(), frame.type());
+		warped.setTo(cv::Scalar(0, 0, 0, 255));
+		int width = frame.cols - std::abs(dx);
+		if(width <= 0 || std::abs(dy) >= frame.rows){
+			return true;
+		}
+		size_t pixelSize = frame.elemSize();
+		for(int y = std::max(0, dy); y < std::min(frame.rows, frame.rows + dy); y++){
+			memcpy(warped.ptr(y) + std::max(0, dx) * pixelSize, frame.ptr(y - dy) + std::max(0, -dx) * pixelSize, width * pixelSize);
+		}
+		return true;
+	}
+
+	Orientation getSourceOrientation(Timestamp t){
+		std::shared_ptr<OrientationSource> s;
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			s = source;
+		}
+		return s->getOrientation(t);
+	}
+};
+
+#endif
@@ -0,0 +1,221 @@
+#ifndef QUALITY_H
+#define QUALITY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+#include "resample.h"
+#include "helper.h"
+
+#define QUALITY_TARGET_FPS 30      //Default frame rate held
+#define QUALITY_WINDOW 30          //Frames measured before each decision
+#define QUALITY_OVER 0.95          //Mean frame time, as a fraction of the budget, above which quality is lowered
+#define QUALITY_LATE 0.25          //Fraction of frames over budget above which quality is lowered
+#define QUALITY_UNDER 0.7          //Mean frame time, as a fraction of the budget, below which quality may come back
+#define QUALITY_RESTORE_WINDOWS 4  //Windows with headroom before a knob is raised, doubled every time raising it fails
+#define QUALITY_MAX_BACKOFF 16
+#define QUALITY_NEVER_RAISED (QUALITY_RESTORE_WINDOWS * QUALITY_MAX_BACKOFF + 1) //Windows since raising, before any raise
+#define QUALITY_THERMAL_PATH "/sys/class/thermal/thermal_zone0/temp"
+#define QUALITY_THERMAL_LIMIT 75   //Degrees C at which quality is lowered, ahead of firmware throttling at 80
+#define QUALITY_THERMAL_MARGIN 3   //Degrees C below the limit before quality may come back
+
+//Quality knobs, lowered in this order and raised in reverse, so the camera is the last to lose detail
+enum QualityKnob{
+	KNOB_MONITOR, //Monitor shows every 1st, 2nd or 4th frame
+	KNOB_MASK,    //Alpha masks and keys are computed every 1st, 2nd or 4th frame
+	KNOB_FILTER,  //Resizes as requested, with Lanczos as bilinear, or all nearest
+	KNOB_CAMERA,  //Camera captured at 1, 3/4 or 1/2 of the resolution its Layers need
+	KNOB_COUNT
+};
+static const char *KNOB_NAMES[KNOB_COUNT] = { "monitor", "mask", "filter", "camera" };
+#define KNOB_LEVELS 3
+static const int QUALITY_INTERVALS[KNOB_LEVELS] = { 1, 2, 4 };
+static const float QUALITY_CAMERA_SCALES[KNOB_LEVELS] = { 1, 0.75f, 0.5f };
+
+//Watches frame times and temperature, lowering quality knobs within their limits to hold a target
+//frame rate, and raising them again once there is headroom. Steady frames matter more than detail
+class QualityController{
+private:
+	bool enabled = false;
+	double targetFps = QUALITY_TARGET_FPS;
+	int levels[KNOB_COUNT] = {};
+	int limits[KNOB_COUNT] = { KNOB_LEVELS - 1, KNOB_LEVELS - 1, KNOB_LEVELS - 1, KNOB_LEVELS - 1 };
+
+	//Current window
+	int frames = 0, late = 0;
+	double sum = 0;
+
+	//Windows with headroom so far, how many are needed, and windows since quality was last raised
+	int headroom = 0, backoff = 1, sinceRaise = QUALITY_NEVER_RAISED;
+
+	std::string thermalPath = QUALITY_THERMAL_PATH;
+	int thermalLimit = QUALITY_THERMAL_LIMIT;
+	double temperature = 0;
+
+public:
+	//Add the time of a frame, returns true if a knob changed
+	bool record(double ms){
+		if(!enabled){
+			return false;
+		}
+		double budget = 1000 / targetFps;
+		frames++;
+		sum += ms;
+		late += ms > budget ? 1 : 0;
+		if(frames < QUALITY_WINDOW){
+			return false;
+		}
+		double mean = sum / frames;
+		bool over = mean > budget * QUALITY_OVER || late > frames * QUALITY_LATE;
+		bool under = mean < budget * QUALITY_UNDER && late == 0;
+		frames = late = 0;
+		sum = 0;
+		sinceRaise = std::min(sinceRaise + 1, QUALITY_NEVER_RAISED);
+
+		//Temperature is read once a window, a hot Pi lowers quality before it is throttled
+		readTemperature();
+		bool hot = temperature >= thermalLimit;
+		bool cooling = temperature >= thermalLimit - QUALITY_THERMAL_MARGIN;
+
+		if(over || hot){
+			headroom = 0;
+			//Raising quality didn't last, wait longer next time
+			if(sinceRaise <= 2){
+				backoff = std::min(backoff * 2, QUALITY_MAX_BACKOFF);
+			}
+			return lower();
+		}
+		if(under && !cooling && ++headroom >= QUALITY_RESTORE_WINDOWS * backoff){
+			headroom = 0;
+			if(raise()){
+				sinceRaise = 0;
+				return true;
+			}
+		}
+		if(!under){
+			headroom = 0;
+		}
+		if(sinceRaise > QUALITY_RESTORE_WINDOWS * QUALITY_MAX_BACKOFF){
+			backoff = 1;
+		}
+		return false;
+	}
+
+	//Level of [knob], 0 is full quality
+	int getLevel(QualityKnob knob){
+		return levels[knob];
+	}
+
+	//Frames between monitor writes, and between mask updates
+	int getMonitorInterval(){
+		return QUALITY_INTERVALS[levels[KNOB_MONITOR]];
+	}
+	int getMaskInterval(){
+		return QUALITY_INTERVALS[levels[KNOB_MASK]];
+	}
+
+	//Fraction of the needed resolution the camera is captured at
+	float getCameraScale(){
+		return QUALITY_CAMERA_SCALES[levels[KNOB_CAMERA]];
+	}
+
+	//Filter used in place of [requested]
+	ResampleFilter getFilter(ResampleFilter requested){
+		if(levels[KNOB_FILTER] == 2){
+			return FILTER_NEAREST;
+		}
+		if(levels[KNOB_FILTER] == 1 && requested == FILTER_LANCZOS){
+			return FILTER_BILINEAR;
+		}
+		return requested;
+	}
+
+	//Enable or disable, disabling restores full quality
+	void setEnabled(bool e){
+		enabled = e;
+		frames = late = headroom = 0;
+		sum = 0;
+		backoff = 1;
+		sinceRaise = QUALITY_NEVER_RAISED;
+		if(!enabled){
+			std::fill(levels, levels + KNOB_COUNT, 0);
+		}
+		printf("Adaptive quality %s\n", enabled ? "enabled" : "disabled");
+	}
+
+	void setTarget(double fps){
+		if(fps <= 0){
+			displayInvalidMessage("Target must be positive");
+			return;
+		}
+		targetFps = fps;
+		printf("Adaptive quality target set to %.1f fps\n", fps);
+	}
+
+	//Limit knob [name] to at most [level], 0 to never lower it
+	void setLimit(std::string name, int level){
+		for(int k = 0; k < KNOB_COUNT; k++){
+			if(name == KNOB_NAMES[k]){
+				limits[k] = std::max(0, std::min(level, KNOB_LEVELS - 1));
+				levels[k] = std::min(levels[k], limits[k]);
+				printf("Quality knob %s limited to level %d\n", KNOB_NAMES[k], limits[k]);
+				return;
+			}
+		}
+		displayInvalidMessage("Unknown knob, expected camera, filter, mask or monitor");
+	}
+
+	//Read the temperature from [path], in degrees C or millidegrees as sysfs reports it, lowering quality at [limit]
+	void setThermal(std::string path, int limit){
+		thermalPath = path;
+		thermalLimit = limit;
+		readTemperature();
+		printf("Reading temperature from %s, %.1f C, limit %d C\n", thermalPath.c_str(), temperature, thermalLimit);
+	}
+
+	void print(){
+		printf("ADAPTIVE QUALITY: %s, target %.1f fps, %.1f C of %d C\n", enabled ? "enabled" : "disabled", targetFps, temperature, thermalLimit);
+		for(int k = 0; k < KNOB_COUNT; k++){
+			printf("  %-8s level %d, limit %d\n", KNOB_NAMES[k], levels[k], limits[k]);
+		}
+	}
+
+private:
+	//Lower the first knob still above its limit, returns false if none is
+	bool lower(){
+		for(int k = 0; k < KNOB_COUNT; k++){
+			if(levels[k] < limits[k]){
+				levels[k]++;
+				printf("Adaptive quality: lowered %s to level %d\n", KNOB_NAMES[k], levels[k]);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//Raise the last lowered knob, returns false if all are at full quality
+	bool raise(){
+		for(int k = KNOB_COUNT - 1; k >= 0; k--){
+			if(levels[k] > 0){
+				levels[k]--;
+				printf("Adaptive quality: raised %s to level %d\n", KNOB_NAMES[k], levels[k]);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	//A missing file reads as cold
+	void readTemperature(){
+		std::ifstream file(thermalPath);
+		double value = 0;
+		if(!(file >> value)){
+			temperature = 0;
+			return;
+		}
+		temperature = value >= 1000 ? value / 1000 : value;
+	}
+};
+
+#endif
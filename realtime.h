@@ -0,0 +1,257 @@
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <sys/mman.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sched.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <map>
+
+#include "helper.h"
+
+//Roles a thread registers under, each scheduled with its own settings
+#define THREAD_ROLES {"render", "terminal", "presenter", "worker", "recorder"}
+
+//Scheduling of every thread with one role
+struct ThreadSettings{
+	std::vector<int> cpus; //Cores the threads may run on, empty for any
+	int priority = 0;      //SCHED_FIFO priority from 1 to 99, 0 for the default scheduler
+};
+
+//Real-time scheduling: pins threads to cores, gives them SCHED_FIFO priorities, and locks memory.
+//Threads register their role when they start, and are updated whenever its settings change
+class RealtimeConfig{
+private:
+	std::mutex mut;
+	std::map<std::string, ThreadSettings> settings;
+	std::multimap<std::string, pthread_t> threads;
+	bool memoryLocked = false;
+
+public:
+	//Schedule the calling thread as [role] until it unregisters. A role with default settings leaves the thread
+	//as it started, so scheduling inherited from taskset or chrt is kept
+	void registerThread(std::string role){
+		std::lock_guard<std::mutex> lock(mut);
+		threads.insert(std::make_pair(role, pthread_self()));
+		const ThreadSettings &s = settings[role];
+		if(!s.cpus.empty() || s.priority > 0){
+			applyLocked(pthread_self(), s, false);
+		}
+	}
+
+	//Forget the calling thread, before it exits
+	void unregisterThread(std::string role){
+		std::lock_guard<std::mutex> lock(mut);
+		std::pair<std::multimap<std::string, pthread_t>::iterator, std::multimap<std::string, pthread_t>::iterator> range = threads.equal_range(role);
+		for(std::multimap<std::string, pthread_t>::iterator i = range.first; i != range.second; i++){
+			if(pthread_equal(i->second, pthread_self())){
+				threads.erase(i);
+				return;
+			}
+		}
+	}
+
+	//Pin [role] to the cores in [list], such as "2", "2,3", "1-3", or "all"
+	bool setCPUs(std::string role, std::string list){
+		std::vector<int> cpus;
+		if(!isRole(role) || !parseCPUs(list, &cpus)){
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mut);
+		settings[role].cpus = cpus;
+		return applyRole(role);
+	}
+
+	//Run [role] with SCHED_FIFO at [priority], or the default scheduler if 0
+	bool setPriority(std::string role, int priority){
+		if(!isRole(role)){
+			return false;
+		}
+		if(priority < 0 || priority > sched_get_priority_max(SCHED_FIFO)){
+			printf("Error: Priority must be from 0 to %d\n", sched_get_priority_max(SCHED_FIFO));
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mut);
+		settings[role].priority = priority;
+		return applyRole(role);
+	}
+
+	//Lock every current and future page in memory, so no page fault stalls a frame
+	bool setMemoryLock(bool locked){
+		std::lock_guard<std::mutex> lock(mut);
+		if(locked == memoryLocked){
+			return true;
+		}
+		if(locked ? mlockall(MCL_CURRENT | MCL_FUTURE) != 0 : munlockall() != 0){
+			printf("Error: Unable to %s memory: %s\n", locked ? "lock" : "unlock", strerror(errno));
+			return false;
+		}
+		memoryLocked = locked;
+		return true;
+	}
+
+	//Load settings from [filename], one "[ROLE] cpus [LIST]", "[ROLE] fifo [INT]" or "lock [true | false]" per line
+	bool load(std::string filename){
+		std::ifstream file(filename);
+		if(!file.is_open()){
+			printf("Error: Unable to open real-time configuration %s\n", filename.c_str());
+			return false;
+		}
+		std::string line;
+		int lineNumber = 0;
+		bool valid = true;
+		while(std::getline(file, line)){
+			lineNumber++;
+			std::vector<std::string> words = splitString(line, " ");
+			words.erase(std::remove(words.begin(), words.end(), ""), words.end());
+			if(words.empty() || words[0][0] == '#'){
+				continue;
+			}
+			bool applied = false;
+			if(words.size() == 2 && words[0] == "lock" && (words[1] == "true" || words[1] == "false")){
+				applied = setMemoryLock(words[1] == "true");
+			}
+			else if(words.size() == 3 && words[1] == "cpus"){
+				applied = setCPUs(words[0], words[2]);
+			}
+			else if(words.size() == 3 && words[1] == "fifo" && canParseInteger(words[2])){
+				applied = setPriority(words[0], parseInteger(words[2]));
+			}
+			else{
+				printf("Error: Invalid real-time setting on line %d of %s\n", lineNumber, filename.c_str());
+			}
+			valid = valid && applied;
+		}
+		printf("Real-time configuration loaded from %s\n", filename.c_str());
+		return valid;
+	}
+
+	bool isMemoryLocked(){
+		return memoryLocked;
+	}
+
+	void print(){
+		std::lock_guard<std::mutex> lock(mut);
+		printf("Memory %s\n", memoryLocked ? "locked" : "not locked");
+		for(std::string role : THREAD_ROLES){
+			const ThreadSettings &s = settings[role];
+			std::string cpus = "any";
+			for(int i = 0; i < s.cpus.size(); i++){
+				cpus = (i == 0 ? "" : cpus + ",") + std::to_string(s.cpus[i]);
+			}
+			printf("%s: %d threads, cpus %s, ", role.c_str(), (int)threads.count(role), cpus.c_str());
+			if(s.priority > 0){
+				printf("fifo %d\n", s.priority);
+			}
+			else{
+				printf("default scheduler\n");
+			}
+		}
+	}
+
+private:
+	static bool isRole(std::string role){
+		for(std::string r : THREAD_ROLES){
+			if(r == role){
+				return true;
+			}
+		}
+		printf("Error: Unknown thread role %s\n", role.c_str());
+		return false;
+	}
+
+	//Parse a list of cores, returns false if any is invalid
+	static bool parseCPUs(std::string list, std::vector<int> *cpus){
+		cpus->clear();
+		if(list == "all"){
+			return true;
+		}
+		int count = std::min((int)sysconf(_SC_NPROCESSORS_CONF), CPU_SETSIZE);
+		for(std::string item : splitString(list, ",")){
+			std::vector<std::string> bounds = splitString(item, "-");
+			if(bounds.size() > 2 || !canParseInteger(bounds[0]) || !canParseInteger(bounds.back())){
+				printf("Error: Invalid core list %s\n", list.c_str());
+				return false;
+			}
+			int first = parseInteger(bounds[0]), last = parseInteger(bounds.back());
+			if(first < 0 || last >= count || first > last){
+				printf("Error: Cores must be from 0 to %d\n", count - 1);
+				return false;
+			}
+			for(int c = first; c <= last; c++){
+				cpus->push_back(c);
+			}
+		}
+		return true;
+	}
+
+	//Apply the settings of [role] to every registered thread
+	bool applyRole(std::string role){
+		bool applied = true;
+		std::pair<std::multimap<std::string, pthread_t>::iterator, std::multimap<std::string, pthread_t>::iterator> range = threads.equal_range(role);
+		for(std::multimap<std::string, pthread_t>::iterator i = range.first; i != range.second; i++){
+			applied = applyLocked(i->second, settings[role], true) && applied;
+		}
+		return applied;
+	}
+
+	//Apply [s] to [thread], reporting errors if [verbose] or a priority was asked for
+	bool applyLocked(pthread_t thread, const ThreadSettings &s, bool verbose){
+		bool applied = true;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		int count = std::min((int)sysconf(_SC_NPROCESSORS_CONF), CPU_SETSIZE);
+		for(int c = 0; c < count; c++){
+			if(s.cpus.empty() || std::find(s.cpus.begin(), s.cpus.end(), c) != s.cpus.end()){
+				CPU_SET(c, &set);
+			}
+		}
+		int error = pthread_setaffinity_np(thread, sizeof(set), &set);
+		if(error != 0){
+			applied = false;
+			if(verbose){
+				printf("Error: Unable to set thread cores: %s\n", strerror(error));
+			}
+		}
+
+		sched_param param = {};
+		param.sched_priority = s.priority;
+		error = pthread_setschedparam(thread, s.priority > 0 ? SCHED_FIFO : SCHED_OTHER, &param);
+		if(error != 0){
+			applied = false;
+			if(verbose || s.priority > 0){
+				printf("Error: Unable to set thread priority: %s\n", strerror(error));
+			}
+		}
+		return applied;
+	}
+};
+
+//Returns the configuration shared by every thread
+RealtimeConfig &getRealtimeConfig(){
+	static RealtimeConfig config;
+	return config;
+}
+
+//Registers the calling thread for as long as it is in scope
+class RealtimeThread{
+private:
+	std::string role;
+
+public:
+	RealtimeThread(std::string r){
+		role = r;
+		getRealtimeConfig().registerThread(role);
+	}
+	~RealtimeThread(){
+		getRealtimeConfig().unregisterThread(role);
+	}
+};
+
+#endif
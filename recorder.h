@@ -0,0 +1,244 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <opencv2/core.hpp>
+#include <fstream>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "sharedFrames.h"
+#include "realtime.h"
+#include "helper.h"
+
+#define RECORD_MAGIC "VTRC"
+#define RECORD_VERSION 1
+#define RECORD_QUEUE_SIZE 8          //Frames waiting for the writer before new ones are dropped
+#define RECORD_KEYFRAME_INTERVAL 60  //Frames between complete frames, so a replay can start part way through
+#define RECORD_BAND 16               //Rows compared together when finding damaged rectangles
+
+//Bounded single-producer single-consumer queue, neither side ever waits on the other
+template<typename T, int N>
+class SPSCQueue{
+private:
+	T items[N];
+	std::atomic<size_t> head; //Next item to pop, only moved by the consumer
+	std::atomic<size_t> tail; //Next item to push, only moved by the producer
+
+public:
+	SPSCQueue(){
+		head = 0;
+		tail = 0;
+	}
+
+	//Add [item], returns false if the queue is full
+	bool push(const T &item){
+		size_t t = tail.load(std::memory_order_relaxed);
+		if(t - head.load(std::memory_order_acquire) == N){
+			return false;
+		}
+		items[t % N] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	//Remove the oldest item into [item], returns false if the queue is empty
+	bool pop(T *item){
+		size_t h = head.load(std::memory_order_relaxed);
+		if(h == tail.load(std::memory_order_acquire)){
+			return false;
+		}
+		*item = items[h % N];
+		items[h % N] = T();
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+};
+
+//Records composites to a file on its own thread. Composites are queued without copying, and dropped
+//rather than waited on when the disk falls behind. After each keyframe, only the rectangles that changed are written.
+//File layout, little-endian: magic, u32 version, u32 width, u32 height, u32 SharedFrameFormat, u32 keyframe interval,
+//then per frame: u64 frame number, i64 capture time in nanoseconds on the monotonic clock, u32 frames dropped before it,
+//u32 rectangle count, and per rectangle: i32 x, y, width, height, followed by its rows of pixels
+class Recorder{
+private:
+	struct QueuedFrame{
+		cv::Mat image;
+		Timestamp captured;
+		uint64_t number = 0;
+	};
+	SPSCQueue<QueuedFrame, RECORD_QUEUE_SIZE> queue;
+
+	std::string filename;
+	std::ofstream file;
+	std::thread writer;
+	std::atomic<bool> recording;
+
+	//Counted by the producer
+	uint64_t submitted = 0;
+	std::atomic<uint64_t> dropped;
+
+	//Used only by the writer
+	cv::Mat previous;
+	uint64_t written = 0, droppedWritten = 0, bytes = 0;
+
+public:
+	Recorder(){
+		recording = false;
+		dropped = 0;
+	}
+	~Recorder(){
+		stop();
+	}
+
+	//Start recording to [name], returns false if it can't be opened
+	bool start(std::string name){
+		stop();
+		file.open(name, std::ios::binary | std::ios::trunc);
+		if(!file.is_open()){
+			printf("Error: Unable to open recording %s\n", name.c_str());
+			return false;
+		}
+		filename = name;
+		submitted = written = droppedWritten = bytes = 0;
+		dropped = 0;
+		previous.release();
+		QueuedFrame stale;
+		while(queue.pop(&stale)){}
+		recording = true;
+		writer = std::thread(&Recorder::writerThread, this);
+		printf("Recording to %s\n", filename.c_str());
+		return true;
+	}
+
+	//Hand a finished composite to the writer, which must not be modified afterwards. Never waits
+	void submit(cv::Mat composite, Timestamp captured){
+		if(!recording){
+			return;
+		}
+		QueuedFrame frame;
+		frame.image = composite;
+		frame.captured = captured;
+		frame.number = ++submitted;
+		if(!queue.push(frame)){
+			dropped++;
+		}
+	}
+
+	//Write every queued frame, then close the file
+	void stop(){
+		if(!recording){
+			return;
+		}
+		recording = false;
+		if(writer.joinable()){
+			writer.join();
+		}
+		file.close();
+		printf("Recorded %lu frames to %s, %.1f MB, %lu dropped\n", (unsigned long)written, filename.c_str(),
+		       bytes / 1048576.0, (unsigned long)dropped.load());
+	}
+
+	bool isRecording(){
+		return recording;
+	}
+
+private:
+	void writerThread(){
+		RealtimeThread realtime("recorder");
+		QueuedFrame frame;
+		while(true){
+			if(queue.pop(&frame)){
+				writeFrame(frame);
+			}
+			else if(!recording){
+				break;
+			}
+			else{
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+		file.flush();
+	}
+
+	void writeFrame(const QueuedFrame &frame){
+		const cv::Mat &image = frame.image;
+		if(written == 0){
+			file.write(RECORD_MAGIC, 4);
+			writeValue((uint32_t)RECORD_VERSION);
+			writeValue((uint32_t)image.cols);
+			writeValue((uint32_t)image.rows);
+			writeValue((uint32_t)SHARED_FORMAT_BGRA);
+			writeValue((uint32_t)RECORD_KEYFRAME_INTERVAL);
+		}
+
+		//Every frame is damaged on a keyframe
+		std::vector<cv::Rect> rects;
+		if(written % RECORD_KEYFRAME_INTERVAL == 0 || previous.size() != image.size()){
+			rects.push_back(cv::Rect(0, 0, image.cols, image.rows));
+		}
+		else{
+			findDamage(previous, image, &rects);
+		}
+
+		//Frames dropped since the last one written
+		uint64_t droppedNow = frame.number - 1 - written;
+		writeValue(frame.number);
+		writeValue(getSharedTimestamp(frame.captured));
+		writeValue((uint32_t)(droppedNow - droppedWritten));
+		writeValue((uint32_t)rects.size());
+		droppedWritten = droppedNow;
+
+		for(const cv::Rect &r : rects){
+			writeValue((int32_t)r.x);
+			writeValue((int32_t)r.y);
+			writeValue((int32_t)r.width);
+			writeValue((int32_t)r.height);
+			size_t rowSize = r.width * image.elemSize();
+			for(int y = r.y; y < r.y + r.height; y++){
+				file.write((const char*)image.ptr(y) + r.x * image.elemSize(), rowSize);
+			}
+			bytes += rowSize * r.height;
+		}
+		previous = image;
+		written++;
+	}
+
+	//Find the changed columns of every band of rows between two BGRA frames
+	static void findDamage(const cv::Mat &a, const cv::Mat &b, std::vector<cv::Rect> *rects){
+		size_t rowSize = a.cols * a.elemSize();
+		for(int y0 = 0; y0 < a.rows; y0 += RECORD_BAND){
+			int y1 = std::min(a.rows, y0 + RECORD_BAND);
+			int left = a.cols, right = -1;
+			for(int y = y0; y < y1; y++){
+				const uint32_t *pa = a.ptr<uint32_t>(y), *pb = b.ptr<uint32_t>(y);
+				if(memcmp(pa, pb, rowSize) == 0){
+					continue;
+				}
+				int l = 0, r = a.cols - 1;
+				while(pa[l] == pb[l]){
+					l++;
+				}
+				while(pa[r] == pb[r]){
+					r--;
+				}
+				left = std::min(left, l);
+				right = std::max(right, r);
+			}
+			if(right >= left){
+				rects->push_back(cv::Rect(left, y0, right - left + 1, y1 - y0));
+			}
+		}
+	}
+
+	template<typename T>
+	void writeValue(T value){
+		file.write((const char*)&value, sizeof(T));
+		bytes += sizeof(T);
+	}
+};
+
+#endif
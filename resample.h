@@ -0,0 +1,318 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <tuple>
+#include <cmath>
+#include <map>
+
+#define SIMD_OPENCV_ENABLE
+#include "Simd/SimdLib.hpp"
+
+//Resampling filters, stored in binary instruction lists, so only ever append
+enum ResampleFilter{
+	FILTER_NEAREST,
+	FILTER_BOX,      //Area average, sharpest without aliasing when shrinking
+	FILTER_BILINEAR,
+	FILTER_LANCZOS   //Lanczos3, sharpest but may ring on hard edges
+};
+
+#define RESAMPLE_BITS 14
+
+//Fixed-point coefficients along one axis: [taps] weights per destination pixel, starting at [start]
+struct ResampleKernel{
+	int taps;
+	std::vector<int> start;
+	std::vector<int16_t> weights;
+};
+
+//Returns the name of [filter]
+static std::string getFilterName(ResampleFilter filter){
+	switch(filter){
+		case FILTER_BOX: return "box";
+		case FILTER_BILINEAR: return "bilinear";
+		case FILTER_LANCZOS: return "lanczos";
+		default: return "nearest";
+	}
+}
+
+//Filter weight at distance [x], in destination pixels
+static double getFilterWeight(ResampleFilter filter, double x){
+	x = std::abs(x);
+	switch(filter){
+		case FILTER_BOX:
+			return x <= 0.5 ? 1 : 0;
+		case FILTER_BILINEAR:
+			return x < 1 ? 1 - x : 0;
+		case FILTER_LANCZOS:
+			if(x == 0){ return 1; }
+			if(x >= 3){ return 0; }
+			return 3 * std::sin(CV_PI * x) * std::sin(CV_PI * x / 3) / (CV_PI * CV_PI * x * x);
+		default:
+			return 0;
+	}
+}
+
+static double getFilterSupport(ResampleFilter filter){
+	switch(filter){
+		case FILTER_BOX: return 0.5;
+		case FILTER_BILINEAR: return 1;
+		case FILTER_LANCZOS: return 3;
+		default: return 0.5;
+	}
+}
+
+//Build the kernel resampling [srcLength] pixels to [dstLength]
+static ResampleKernel buildResampleKernel(int srcLength, int dstLength, ResampleFilter filter){
+	ResampleKernel kernel;
+	double ratio = (double)srcLength / dstLength;
+	double filterScale = std::max(1.0, ratio); //Widen the filter when shrinking
+	double support = getFilterSupport(filter) * filterScale;
+	kernel.taps = std::min((int)std::ceil(support) * 2 + 1, srcLength);
+	kernel.start.resize(dstLength);
+	kernel.weights.assign((size_t)dstLength * kernel.taps, 0);
+
+	std::vector<double> w(kernel.taps);
+	for(int i = 0; i < dstLength; i++){
+		double center = (i + 0.5) * ratio;
+		int first = std::max(0, (int)std::floor(center - support));
+		int last = std::min(srcLength, (int)std::ceil(center + support));
+		int count = std::min(last - first, kernel.taps);
+
+		//Normalized weights
+		double sum = 0;
+		for(int k = 0; k < count; k++){
+			w[k] = getFilterWeight(filter, (first + k + 0.5 - center) / filterScale);
+			sum += w[k];
+		}
+
+		//Fixed-point weights, with rounding error given to the largest so they sum to exactly one
+		int16_t *out = &kernel.weights[(size_t)i * kernel.taps];
+		int total = 0, largest = 0;
+		for(int k = 0; k < count; k++){
+			out[k] = (int16_t)std::lround((sum != 0 ? w[k] / sum : (k == 0)) * (1 << RESAMPLE_BITS));
+			total += out[k];
+			largest = out[k] > out[largest] ? k : largest;
+		}
+		out[largest] += (1 << RESAMPLE_BITS) - total;
+		kernel.start[i] = first;
+
+		//Keep every tap inside the source
+		if(first + kernel.taps > srcLength){
+			int shift = std::min(first, first + kernel.taps - srcLength);
+			std::copy_backward(out, out + count, out + count + shift);
+			std::fill(out, out + shift, 0);
+			kernel.start[i] = first - shift;
+		}
+	}
+	return kernel;
+}
+
+//Returns the kernel resampling [srcLength] pixels to [dstLength], built on first use and shared
+static std::shared_ptr<const ResampleKernel> getResampleKernel(int srcLength, int dstLength, ResampleFilter filter){
+	static std::mutex mut;
+	static std::map<std::tuple<int, int, int>, std::shared_ptr<const ResampleKernel>> cache;
+
+	std::tuple<int, int, int> key(srcLength, dstLength, filter);
+	std::lock_guard<std::mutex> lock(mut);
+	std::map<std::tuple<int, int, int>, std::shared_ptr<const ResampleKernel>>::iterator found = cache.find(key);
+	if(found != cache.end()){
+		return found->second;
+	}
+	std::shared_ptr<const ResampleKernel> kernel = std::make_shared<const ResampleKernel>(buildResampleKernel(srcLength, dstLength, filter));
+	cache[key] = kernel;
+	return kernel;
+}
+
+static inline uchar clipResampled(int value){
+	value = (value + (1 << (RESAMPLE_BITS - 1))) >> RESAMPLE_BITS;
+	return (uchar)std::max(0, std::min(value, 255));
+}
+
+//Halve an 8-bit image in both directions, averaging every 2x2 block, with each band of rows reduced by Simd
+static void resampleHalfBox(const cv::Mat &src, cv::Mat &dst){
+	cv::parallel_for_(cv::Range(0, dst.rows), [&](const cv::Range &range){
+		Simd::View<Simd::Allocator> in = src.rowRange(range.start * 2, range.end * 2);
+		Simd::View<Simd::Allocator> out = dst.rowRange(range.start, range.end);
+		Simd::ReduceColor2x2(in, out);
+	});
+}
+
+//Resample one row to the width of [kernel], with the channel count fixed so the tap loop unrolls
+template<int CHANNELS>
+static void resampleRow(const uchar *in, uchar *out, const ResampleKernel &kernel, int width){
+	for(int x = 0; x < width; x++){
+		const int16_t *w = &kernel.weights[(size_t)x * kernel.taps];
+		const uchar *p = in + kernel.start[x] * CHANNELS;
+		int acc[CHANNELS] = {};
+		for(int k = 0; k < kernel.taps; k++, p += CHANNELS){
+			for(int c = 0; c < CHANNELS; c++){
+				acc[c] += w[k] * p[c];
+			}
+		}
+		for(int c = 0; c < CHANNELS; c++){
+			out[x * CHANNELS + c] = clipResampled(acc[c]);
+		}
+	}
+}
+
+//Kernel for destination pixels [first, first + count) of an axis resampled from [srcLength] to [dstLength], reading
+//only the [localLength] source pixels from [localStart]. Taps outside them are moved to the nearest edge
+static ResampleKernel getRegionKernel(int srcLength, int dstLength, int first, int count, int localStart, int localLength, ResampleFilter filter){
+	std::shared_ptr<const ResampleKernel> full = getResampleKernel(srcLength, dstLength, filter);
+	ResampleKernel kernel;
+	kernel.taps = std::min(full->taps, localLength);
+	kernel.start.resize(count);
+	kernel.weights.assign((size_t)count * kernel.taps, 0);
+	for(int i = 0; i < count; i++){
+		int d = std::min(first + i, dstLength - 1);
+		int fullStart = full->start[d] - localStart;
+		const int16_t *w = &full->weights[(size_t)d * full->taps];
+		int start = std::max(0, std::min(fullStart, localLength - kernel.taps));
+		int16_t *out = &kernel.weights[(size_t)i * kernel.taps];
+		for(int k = 0; k < full->taps; k++){
+			out[std::max(0, std::min(fullStart + k, localLength - 1)) - start] += w[k];
+		}
+		kernel.start[i] = start;
+	}
+	return kernel;
+}
+
+//Resample with separable kernels [kx] and [ky] into [result], already allocated at the destination size
+static void resampleSeparable(const cv::Mat &src, cv::Mat &result, const ResampleKernel &kx, const ResampleKernel &ky){
+	int channels = src.channels();
+	cv::Size dstSize = result.size();
+
+	//Horizontal pass, every source row to the destination width
+	static thread_local cv::Mat buffer;
+	cv::Mat &horizontal = buffer;
+	horizontal.create(src.rows, dstSize.width, src.type());
+	cv::parallel_for_(cv::Range(0, src.rows), [&](const cv::Range &range){
+		for(int y = range.start; y < range.end; y++){
+			const uchar *in = src.ptr(y);
+			uchar *out = horizontal.ptr(y);
+			switch(channels){
+				case 4: resampleRow<4>(in, out, kx, dstSize.width); break;
+				case 3: resampleRow<3>(in, out, kx, dstSize.width); break;
+				case 2: resampleRow<2>(in, out, kx, dstSize.width); break;
+				default: resampleRow<1>(in, out, kx, dstSize.width); break;
+			}
+		}
+	});
+
+	//Vertical pass, accumulated a whole row at a time
+	int width = dstSize.width * channels;
+	cv::parallel_for_(cv::Range(0, dstSize.height), [&](const cv::Range &range){
+		std::vector<int> acc(width);
+		for(int y = range.start; y < range.end; y++){
+			const int16_t *w = &ky.weights[(size_t)y * ky.taps];
+			std::fill(acc.begin(), acc.end(), 0);
+			for(int k = 0; k < ky.taps; k++){
+				if(w[k] == 0){
+					continue;
+				}
+				const uchar *in = horizontal.ptr(ky.start[y] + k);
+				int weight = w[k];
+				for(int x = 0; x < width; x++){
+					acc[x] += weight * in[x];
+				}
+			}
+			uchar *out = result.ptr(y);
+			for(int x = 0; x < width; x++){
+				out[x] = clipResampled(acc[x]);
+			}
+		}
+	});
+}
+
+//Resample an 8-bit image to [dstSize] with [filter]. [dst] may be [src]
+void resample(const cv::Mat &src, cv::Mat &dst, cv::Size dstSize, ResampleFilter filter){
+	if(src.empty() || dstSize.width <= 0 || dstSize.height <= 0){
+		dst.release();
+		return;
+	}
+	if(filter == FILTER_NEAREST || src.depth() != CV_8U || src.channels() > 4){
+		cv::resize(src, dst, dstSize, 0, 0, filter == FILTER_NEAREST ? cv::INTER_NEAREST : cv::INTER_AREA);
+		return;
+	}
+	if(src.size() == dstSize){
+		if(dst.data != src.data){
+			src.copyTo(dst);
+		}
+		return;
+	}
+
+	//Reuse dst unless it is also the source
+	cv::Mat result = dst.data == src.data ? cv::Mat() : dst;
+	result.create(dstSize, src.type());
+
+	//Exact 2:1 box
+	if(filter == FILTER_BOX && src.cols == dstSize.width * 2 && src.rows == dstSize.height * 2){
+		resampleHalfBox(src, result);
+		dst = result;
+		return;
+	}
+
+	resampleSeparable(src, result, *getResampleKernel(src.cols, dstSize.width, filter), *getResampleKernel(src.rows, dstSize.height, filter));
+	dst = result;
+}
+
+//Resample [src], the region at [srcOrigin] of an image [srcFull] in size, to region [dstRect] of that image resized
+//to [dstFull]. Every pixel matches the whole image resized, as long as [src] holds the filter's taps. [dst] may be [src]
+void resample(const cv::Mat &src, cv::Point srcOrigin, cv::Size srcFull, cv::Mat &dst, cv::Rect dstRect, cv::Size dstFull, ResampleFilter filter){
+	if(src.empty() || dstRect.area() <= 0 || dstFull.area() <= 0){
+		dst.release();
+		return;
+	}
+	if(src.depth() != CV_8U || src.channels() > 4){
+		cv::resize(src, dst, dstRect.size(), 0, 0, cv::INTER_AREA);
+		return;
+	}
+	cv::Mat result = dst.data == src.data ? cv::Mat() : dst;
+	result.create(dstRect.size(), src.type());
+
+	//Nearest picks the source pixel cv::resize would for the whole image
+	if(filter == FILTER_NEAREST){
+		double rx = (double)srcFull.width / dstFull.width, ry = (double)srcFull.height / dstFull.height;
+		std::vector<int> columns(dstRect.width);
+		for(int x = 0; x < dstRect.width; x++){
+			columns[x] = std::max(0, std::min((int)std::floor((dstRect.x + x) * rx) - srcOrigin.x, src.cols - 1));
+		}
+		size_t pixelSize = src.elemSize();
+		cv::parallel_for_(cv::Range(0, dstRect.height), [&](const cv::Range &range){
+			for(int y = range.start; y < range.end; y++){
+				const uchar *in = src.ptr(std::max(0, std::min((int)std::floor((dstRect.y + y) * ry) - srcOrigin.y, src.rows - 1)));
+				uchar *out = result.ptr(y);
+				for(int x = 0; x < dstRect.width; x++){
+					memcpy(out + x * pixelSize, in + columns[x] * pixelSize, pixelSize);
+				}
+			}
+		});
+		dst = result;
+		return;
+	}
+
+	//Exact 2:1 box, on the source pixels under the region
+	cv::Rect under(dstRect.x * 2 - srcOrigin.x, dstRect.y * 2 - srcOrigin.y, dstRect.width * 2, dstRect.height * 2);
+	if(filter == FILTER_BOX && srcFull.width == dstFull.width * 2 && srcFull.height == dstFull.height * 2 &&
+	   (under & cv::Rect(0, 0, src.cols, src.rows)) == under){
+		resampleHalfBox(src(under), result);
+		dst = result;
+		return;
+	}
+
+	resampleSeparable(src, result,
+	                  getRegionKernel(srcFull.width, dstFull.width, dstRect.x, dstRect.width, srcOrigin.x, src.cols, filter),
+	                  getRegionKernel(srcFull.height, dstFull.height, dstRect.y, dstRect.height, srcOrigin.y, src.rows, filter));
+	dst = result;
+}
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef ROTATE_H
+#define ROTATE_H
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/core.hpp>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <cmath>
+#include <map>
+
+#define ROTATION_CACHE_SIZE 16 //Arbitrary angle tables kept at once
+
+//Fixed-point source coordinates for every destination pixel of a rotation
+struct RotationMaps{
+	cv::Mat xy;    //Integer coordinates, CV_16SC2
+	cv::Mat frac;  //Interpolation table indices, CV_16UC1
+};
+
+//Returns [angle] in degrees, wrapped to [0, 360)
+static float normalizeAngle(float angle){
+	angle = std::fmod(angle, 360.0f);
+	return angle < 0 ? angle + 360 : angle;
+}
+
+//Size of an image of [size] rotated by [angle], expanded to fit its bounding box if [expand]
+static cv::Size getRotatedSize(cv::Size size, float angle, bool expand){
+	if(!expand){
+		return size;
+	}
+	double radians = angle * CV_PI / 180;
+	double c = std::abs(std::cos(radians)), s = std::abs(std::sin(radians));
+	return cv::Size((int)std::lround(size.width * c + size.height * s), (int)std::lround(size.width * s + size.height * c));
+}
+
+//Build the maps rotating [size] counter-clockwise by [angle] about its center
+static RotationMaps buildRotationMaps(cv::Size size, float angle, bool expand){
+	cv::Size dstSize = getRotatedSize(size, angle, expand);
+	cv::Point2f center((size.width - 1) / 2.0, (size.height - 1) / 2.0);
+	cv::Mat forward = cv::getRotationMatrix2D(center, angle, 1.0);
+	forward.at<double>(0, 2) += (dstSize.width - size.width) / 2.0;
+	forward.at<double>(1, 2) += (dstSize.height - size.height) / 2.0;
+	cv::Mat inverse;
+	cv::invertAffineTransform(forward, inverse);
+
+	//Source coordinates of every destination pixel
+	cv::Mat map(dstSize, CV_32FC2);
+	const double *m = inverse.ptr<double>(0);
+	for(int y = 0; y < dstSize.height; y++){
+		cv::Vec2f *row = map.ptr<cv::Vec2f>(y);
+		for(int x = 0; x < dstSize.width; x++){
+			row[x] = cv::Vec2f((float)(m[0] * x + m[1] * y + m[2]), (float)(m[3] * x + m[4] * y + m[5]));
+		}
+	}
+
+	RotationMaps maps;
+	cv::convertMaps(map, cv::Mat(), maps.xy, maps.frac, CV_16SC2);
+	return maps;
+}
+
+//Returns the maps for a rotation, built on first use and kept for repeated angles
+static std::shared_ptr<const RotationMaps> getRotationMaps(cv::Size size, float angle, bool expand){
+	static std::mutex mut;
+	static std::map<std::tuple<int, int, float, bool>, std::shared_ptr<const RotationMaps>> cache;
+
+	std::tuple<int, int, float, bool> key(size.width, size.height, angle, expand);
+	std::lock_guard<std::mutex> lock(mut);
+	std::map<std::tuple<int, int, float, bool>, std::shared_ptr<const RotationMaps>>::iterator found = cache.find(key);
+	if(found != cache.end()){
+		return found->second;
+	}
+	if(cache.size() >= ROTATION_CACHE_SIZE){
+		cache.clear();
+	}
+	std::shared_ptr<const RotationMaps> maps = std::make_shared<const RotationMaps>(buildRotationMaps(size, angle, expand));
+	cache[key] = maps;
+	return maps;
+}
+
+//Rotate [src] counter-clockwise by [angle] degrees about its center into [dst], which may be [src].
+//The result keeps the size of [src], or grows to hold all of it if [expand]. Uncovered pixels are transparent.
+//Returns whether every pixel of the result comes from [src]
+bool rotateImage(const cv::Mat &src, cv::Mat &dst, float angle, bool expand){
+	angle = normalizeAngle(angle);
+	int quarter = (int)std::lround(angle / 90) % 4;
+	bool exact = std::abs(angle - std::lround(angle / 90) * 90) < 1e-4;
+
+	if(exact && quarter == 0){
+		if(dst.data != src.data){
+			src.copyTo(dst);
+		}
+		return true;
+	}
+	if(exact && quarter == 2){
+		cv::Mat result;
+		cv::flip(src, result, -1);
+		dst = result;
+		return true;
+	}
+	if(exact){
+		//Transpose and flip, counter-clockwise as with arbitrary angles
+		cv::Mat rotated;
+		cv::rotate(src, rotated, quarter == 1 ? cv::ROTATE_90_COUNTERCLOCKWISE : cv::ROTATE_90_CLOCKWISE);
+		if(expand || rotated.size() == src.size()){
+			dst = rotated;
+			return true;
+		}
+
+		//Center in the original size, cropping or leaving transparent borders
+		cv::Mat result(src.size(), src.type(), cv::Scalar::all(0));
+		int x = (src.cols - rotated.cols) / 2, y = (src.rows - rotated.rows) / 2;
+		cv::Rect dstRect = cv::Rect(x, y, rotated.cols, rotated.rows) & cv::Rect(0, 0, src.cols, src.rows);
+		rotated(dstRect - cv::Point(x, y)).copyTo(result(dstRect));
+		dst = result;
+		return false;
+	}
+
+	std::shared_ptr<const RotationMaps> maps = getRotationMaps(src.size(), angle, expand);
+	cv::Mat result;
+	cv::remap(src, result, maps->xy, maps->frac, cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+	dst = result;
+	return false;
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef SCRIPT_H
+#define SCRIPT_H
+
+#include <functional>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "instructionPlan.h"
+#include "helper.h"
+
+//Verifies a command against the Command Tree, collecting its flags
+typedef std::function<bool(const std::vector<std::string>&, std::vector<int>*)> CommandVerifier;
+
+//Terminal commands read from a script file. Lines starting with "at [TIME]" run [TIME] after the
+//script starts, in seconds ("5", "5.0s") or milliseconds ("500ms"). All other lines run immediately
+class Script{
+public:
+	struct Step{
+		double time; //Seconds after start, negative to run immediately
+		Instruction inst;
+	};
+
+private:
+	std::vector<Step> immediate;
+	std::vector<Step> timed;
+	int nextTimed = 0;
+	Timestamp start;
+	std::string name = "";
+
+public:
+	//Read and verify every line of [filename], returns false if it can't be opened
+	bool load(std::string filename, CommandVerifier verify){
+		std::ifstream file(filename);
+		if(!file.is_open()){
+			printf("Error: Unable to open script %s\n", filename.c_str());
+			return false;
+		}
+		immediate.clear();
+		timed.clear();
+		nextTimed = 0;
+		name = filename;
+
+		std::string line;
+		int lineNumber = 0;
+		while(getline(file, line)){
+			lineNumber++;
+			if(line == "" || line[0] == '#'){
+				continue;
+			}
+			Step step;
+			step.time = -1;
+			std::vector<std::string> words = splitString(line, " ");
+
+			//Timed step
+			if(words.size() > 2 && words[0] == "at"){
+				step.time = parseTime(words[1]);
+				if(step.time < 0){
+					printf("Error: Invalid time %s on line %d of %s\n", words[1].c_str(), lineNumber, filename.c_str());
+					continue;
+				}
+				words.erase(words.begin(), words.begin() + 2);
+			}
+
+			step.inst.command = words;
+			if(!verify(step.inst.command, &step.inst.flags)){
+				printf("Skipping line %d of %s\n", lineNumber, filename.c_str());
+				continue;
+			}
+			(step.time < 0 ? immediate : timed).push_back(step);
+		}
+		file.close();
+
+		//Timed steps in order of time, keeping file order for equal times
+		std::stable_sort(timed.begin(), timed.end(), [](const Step &a, const Step &b){ return a.time < b.time; });
+		printf("Script %s read: %d immediate and %d timed commands\n", filename.c_str(), (int)immediate.size(), (int)timed.size());
+		return true;
+	}
+
+	//Start the timeline at [t]
+	void startAt(Timestamp t){
+		start = t;
+		nextTimed = 0;
+	}
+
+	//Remove every timed step
+	void stop(){
+		timed.clear();
+		nextTimed = 0;
+	}
+
+	//Return the timed steps due at frame time [t], in order
+	std::vector<Instruction> getDue(Timestamp t){
+		std::vector<Instruction> result;
+		double seconds = getMilliseconds(start, t) / 1000.0;
+		while(nextTimed < timed.size() && timed[nextTimed].time <= seconds){
+			result.push_back(timed[nextTimed++].inst);
+		}
+		return result;
+	}
+
+	//Get methods
+	const std::vector<Step> &getImmediateSteps() const{
+		return immediate;
+	}
+	const std::vector<Step> &getTimedSteps() const{
+		return timed;
+	}
+	bool isRunning() const{
+		return nextTimed < timed.size();
+	}
+	std::string getName() const{
+		return name;
+	}
+
+private:
+	//Parse "5", "5.0s" or "500ms" into seconds, -1 if invalid
+	static double parseTime(std::string word){
+		double scale = 1;
+		if(word.length() > 2 && word.compare(word.length() - 2, 2, "ms") == 0){
+			word = word.substr(0, word.length() - 2);
+			scale = 0.001;
+		}
+		else if(word.length() > 1 && word[word.length() - 1] == 's'){
+			word = word.substr(0, word.length() - 1);
+		}
+		if(!canParseFloat(word)){
+			return -1;
+		}
+		double time = parseFloat(word) * scale;
+		return time >= 0 ? time : -1;
+	}
+};
+
+#endif
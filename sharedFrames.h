@@ -0,0 +1,376 @@
+#ifndef SHARED_FRAMES_H
+#define SHARED_FRAMES_H
+
+#include <opencv2/core.hpp>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <atomic>
+
+#include "helper.h"
+
+#define SHARED_FRAME_MAGIC 0x4C465456 //"VTFL", little-endian
+#define SHARED_FRAME_VERSION 1
+#define SHARED_FRAME_SLOTS 3          //Frames kept, so a reader has two frame times to finish with one
+
+//Pixel formats of shared frames, so only ever append
+enum SharedFrameFormat{
+	SHARED_FORMAT_BGRA, //4 bytes per pixel, straight alpha
+	SHARED_FORMAT_YUYV, //2 bytes per pixel, YUV 4:2:2
+	SHARED_FORMAT_NV12  //Y plane, then interleaved UV at half resolution, [stride] bytes per row of each
+};
+
+//Frame flags
+#define SHARED_FLAG_OPAQUE 1 //Every alpha is 255
+
+//One frame of the ring. [sequence] is odd while the frame is being written, and changes with every write,
+//so a reader knows the frame is complete if it reads the same even sequence before and after using it
+struct SharedFrameSlot{
+	std::atomic<uint32_t> sequence;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t stride;      //Bytes per row
+	uint32_t flags;
+	uint64_t frameNumber;
+	int64_t timestamp;    //Capture time, nanoseconds on the monotonic clock
+};
+
+//Start of the shared memory, followed by every slot's pixels at [dataOffset] + slot * [slotSize]
+struct SharedFrameHeader{
+	uint32_t magic;       //Written last, once the rest of the header is valid
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t writerPid;   //Process publishing, to tell a running writer from one that exited without unlinking
+	uint64_t dataOffset;
+	uint64_t slotSize;    //Bytes available to the pixels of each slot
+	std::atomic<uint32_t> latestSlot; //Slot of the newest complete frame
+	std::atomic<uint32_t> writerAlive;
+	SharedFrameSlot slots[SHARED_FRAME_SLOTS];
+};
+
+//Returns the name of a POSIX shared memory object
+static std::string getSharedFrameName(std::string name){
+	return name[0] == '/' ? name : "/" + name;
+}
+
+static int64_t getSharedTimestamp(Timestamp t){
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t.time_since_epoch()).count();
+}
+
+//Bytes of a frame of [rows] rows of [stride] bytes, in [format]
+static size_t getSharedFrameBytes(SharedFrameFormat format, size_t stride, size_t rows){
+	return format == SHARED_FORMAT_NV12 ? stride * (rows + (rows + 1) / 2) : stride * rows;
+}
+
+//Publishes frames to a ring in POSIX shared memory, readable by other processes without copies or system calls.
+//Writing never waits on readers, a reader too slow for the ring sees the sequence change and reads again
+class SharedFrameWriter{
+private:
+	std::string name;
+	int fd = -1;
+	char *mapped = 0;
+	size_t mapSize = 0;
+	SharedFrameHeader *header = 0;
+	uint64_t frameNumber = 0;
+
+public:
+	SharedFrameWriter(){}
+	~SharedFrameWriter(){
+		close();
+	}
+
+	//Create shared memory [n] for frames of up to [size] in [format], returns false on failure
+	bool open(std::string n, cv::Size size, SharedFrameFormat format=SHARED_FORMAT_BGRA){
+		close();
+		name = getSharedFrameName(n);
+		long int pageSize = sysconf(_SC_PAGESIZE);
+		size_t dataOffset = (sizeof(SharedFrameHeader) + pageSize - 1) / pageSize * pageSize;
+		size_t stride = size.width * (format == SHARED_FORMAT_BGRA ? 4 : format == SHARED_FORMAT_YUYV ? 2 : 1);
+		size_t slotSize = (getSharedFrameBytes(format, stride, size.height) + pageSize - 1) / pageSize * pageSize;
+		mapSize = dataOffset + slotSize * SHARED_FRAME_SLOTS;
+
+		//Never resize memory others have mapped, which would fault their reads. Memory left by a writer
+		//that has exited is unlinked, readers keep their mapping of it
+		fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		if(fd < 0 && errno == EEXIST){
+			pid_t owner = getSharedWriter(name);
+			if(owner != 0){
+				printf("Error: Shared memory %s is already published by process %d\n", name.c_str(), (int)owner);
+				return false;
+			}
+			shm_unlink(name.c_str());
+			fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		}
+		if(fd < 0 || ftruncate(fd, mapSize) != 0){
+			printf("Error: Unable to create shared memory %s: %s\n", name.c_str(), strerror(errno));
+			close();
+			return false;
+		}
+		mapped = (char*)mmap(0, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(mapped == MAP_FAILED){
+			printf("Error: Unable to memory map shared memory %s\n", name.c_str());
+			mapped = 0;
+			close();
+			return false;
+		}
+
+		//Header, made visible by the magic
+		header = (SharedFrameHeader*)mapped;
+		header->magic = 0;
+		header->version = SHARED_FRAME_VERSION;
+		header->slotCount = SHARED_FRAME_SLOTS;
+		header->dataOffset = dataOffset;
+		header->slotSize = slotSize;
+		header->writerPid = getpid();
+		header->latestSlot.store(0, std::memory_order_relaxed);
+		header->writerAlive.store(1, std::memory_order_relaxed);
+		for(int i = 0; i < SHARED_FRAME_SLOTS; i++){
+			SharedFrameSlot &s = header->slots[i];
+			s.sequence.store(0, std::memory_order_relaxed);
+			s.format = format;
+			s.width = s.height = s.stride = s.flags = 0;
+			s.frameNumber = 0;
+			s.timestamp = 0;
+		}
+		std::atomic_thread_fence(std::memory_order_release);
+		header->magic = SHARED_FRAME_MAGIC;
+		frameNumber = 0;
+		printf("Publishing frames to shared memory %s\n", name.c_str());
+		return true;
+	}
+
+	//Copy [frame] into the next slot and make it the newest, returns false if it doesn't fit.
+	//An NV12 [frame] has 3/2 the rows of the image
+	bool publish(const cv::Mat &frame, SharedFrameFormat format, Timestamp captured, uint32_t flags=0){
+		size_t rowSize = frame.cols * frame.elemSize();
+		if(header == 0 || rowSize * frame.rows > header->slotSize){
+			return false;
+		}
+		uint32_t index = (header->latestSlot.load(std::memory_order_relaxed) + 1) % SHARED_FRAME_SLOTS;
+		SharedFrameSlot &s = header->slots[index];
+		char *data = mapped + header->dataOffset + index * header->slotSize;
+
+		//Odd while writing
+		uint32_t sequence = s.sequence.load(std::memory_order_relaxed);
+		s.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		if(frame.isContinuous()){
+			memcpy(data, frame.data, rowSize * frame.rows);
+		}
+		else{
+			for(int y = 0; y < frame.rows; y++){
+				memcpy(data + y * rowSize, frame.ptr(y), rowSize);
+			}
+		}
+		s.format = format;
+		s.width = frame.cols;
+		s.height = format == SHARED_FORMAT_NV12 ? frame.rows * 2 / 3 : frame.rows;
+		s.stride = rowSize;
+		s.flags = flags;
+		s.frameNumber = ++frameNumber;
+		s.timestamp = getSharedTimestamp(captured);
+
+		s.sequence.store(sequence + 2, std::memory_order_release);
+		header->latestSlot.store(index, std::memory_order_release);
+		return true;
+	}
+
+	//Remove the shared memory, readers keep their mapping until they close it
+	void close(){
+		if(header != 0){
+			header->writerAlive.store(0, std::memory_order_release);
+			header = 0;
+		}
+		if(mapped != 0){
+			munmap(mapped, mapSize);
+			mapped = 0;
+		}
+		if(fd >= 0){
+			::close(fd);
+			shm_unlink(name.c_str());
+			fd = -1;
+		}
+	}
+
+	bool isOpen(){
+		return header != 0;
+	}
+	std::string getName(){
+		return name;
+	}
+	uint64_t getFrameNumber(){
+		return frameNumber;
+	}
+
+private:
+	//Process still publishing to existing shared memory [n], 0 if its writer has stopped or exited, or it isn't a frame ring
+	static pid_t getSharedWriter(std::string n){
+		int existing = shm_open(n.c_str(), O_RDONLY, 0);
+		if(existing < 0){
+			return 0;
+		}
+		struct stat info;
+		pid_t owner = 0;
+		if(fstat(existing, &info) == 0 && info.st_size >= sizeof(SharedFrameHeader)){
+			void *view = mmap(0, sizeof(SharedFrameHeader), PROT_READ, MAP_SHARED, existing, 0);
+			if(view != MAP_FAILED){
+				const SharedFrameHeader *h = (const SharedFrameHeader*)view;
+				if(h->magic == SHARED_FRAME_MAGIC && h->writerAlive.load(std::memory_order_acquire) != 0 &&
+				   h->writerPid != 0 && (kill(h->writerPid, 0) == 0 || errno == EPERM)){
+					owner = h->writerPid;
+				}
+				munmap(view, sizeof(SharedFrameHeader));
+			}
+		}
+		::close(existing);
+		return owner;
+	}
+};
+
+//A frame read in place from shared memory
+struct SharedFrame{
+	cv::Mat image;      //Pixels in the shared memory, an NV12 image has 3/2 the rows of the frame
+	cv::Size size;
+	SharedFrameFormat format;
+	uint32_t flags;
+	uint64_t frameNumber;
+	Timestamp captured;
+	uint32_t slot;      //Slot and sequence it was read at, to check it wasn't overwritten while it was used
+	uint32_t sequence;
+};
+
+//Maps frames published by another process, and reads the newest in place
+class SharedFrameReader{
+private:
+	std::string name;
+	int fd = -1;
+	char *mapped = 0;
+	size_t mapSize = 0;
+	const SharedFrameHeader *header = 0;
+
+public:
+	SharedFrameReader(){}
+	SharedFrameReader(const SharedFrameReader&) = delete;
+	SharedFrameReader &operator=(const SharedFrameReader&) = delete;
+	~SharedFrameReader(){
+		close();
+	}
+
+	//Map shared memory [n], returns false if it doesn't exist or isn't a frame ring. Errors are printed if [verbose]
+	bool open(std::string n, bool verbose=true){
+		close();
+		name = getSharedFrameName(n);
+		struct stat info;
+		fd = shm_open(name.c_str(), O_RDONLY, 0);
+		if(fd < 0 || fstat(fd, &info) != 0 || info.st_size < sizeof(SharedFrameHeader)){
+			if(verbose){
+				printf("Error: Unable to open shared memory %s\n", name.c_str());
+			}
+			close();
+			return false;
+		}
+		mapSize = info.st_size;
+		mapped = (char*)mmap(0, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+		if(mapped == MAP_FAILED){
+			mapped = 0;
+			close();
+			return false;
+		}
+
+		//Header is only valid once the magic is set
+		header = (const SharedFrameHeader*)mapped;
+		bool valid = header->magic == SHARED_FRAME_MAGIC;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		valid = valid && header->version == SHARED_FRAME_VERSION && header->slotCount == SHARED_FRAME_SLOTS &&
+		        header->dataOffset + header->slotSize * header->slotCount <= mapSize;
+		if(!valid){
+			if(verbose){
+				printf("Error: Shared memory %s is not a ViveToPi frame ring\n", name.c_str());
+			}
+			close();
+			return false;
+		}
+		printf("Reading frames from shared memory %s\n", name.c_str());
+		return true;
+	}
+
+	//Returns the newest complete frame in [frame] without copying it, false if there is none.
+	//The frame stays valid until the writer comes back around the ring, check with isUnchanged after using it
+	bool getLatest(SharedFrame *frame) const{
+		if(header == 0){
+			return false;
+		}
+		for(int attempt = 0; attempt < SHARED_FRAME_SLOTS; attempt++){
+			uint32_t index = header->latestSlot.load(std::memory_order_acquire) % SHARED_FRAME_SLOTS;
+			const SharedFrameSlot &s = header->slots[index];
+			uint32_t before = s.sequence.load(std::memory_order_acquire);
+			if(before == 0 || before % 2 == 1){
+				continue;
+			}
+			SharedFrameFormat format = (SharedFrameFormat)s.format;
+			cv::Size size(s.width, s.height);
+			uint32_t stride = s.stride, flags = s.flags;
+			uint64_t number = s.frameNumber;
+			int64_t timestamp = s.timestamp;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if(s.sequence.load(std::memory_order_relaxed) != before){
+				continue;
+			}
+
+			//Reject anything that doesn't fit its slot
+			int type = format == SHARED_FORMAT_BGRA ? CV_8UC4 : format == SHARED_FORMAT_YUYV ? CV_8UC2 : CV_8UC1;
+			size_t elemSize = format == SHARED_FORMAT_BGRA ? 4 : format == SHARED_FORMAT_YUYV ? 2 : 1;
+			if(format > SHARED_FORMAT_NV12 || size.area() <= 0 || stride < size.width * elemSize ||
+			   getSharedFrameBytes(format, stride, size.height) > header->slotSize){
+				return false;
+			}
+			int rows = format == SHARED_FORMAT_NV12 ? size.height + (size.height + 1) / 2 : size.height;
+			frame->image = cv::Mat(rows, size.width, type, mapped + header->dataOffset + index * header->slotSize, stride);
+			frame->size = size;
+			frame->format = format;
+			frame->flags = flags;
+			frame->frameNumber = number;
+			frame->captured = Timestamp(std::chrono::duration_cast<Timestamp::duration>(std::chrono::nanoseconds(timestamp)));
+			frame->slot = index;
+			frame->sequence = before;
+			return true;
+		}
+		return false;
+	}
+
+	//Returns whether the writer hasn't started overwriting [frame] since it was read, so everything read from it is whole
+	bool isUnchanged(const SharedFrame &frame) const{
+		std::atomic_thread_fence(std::memory_order_acquire);
+		return header != 0 && header->slots[frame.slot].sequence.load(std::memory_order_relaxed) == frame.sequence;
+	}
+
+	//Returns whether the writer still publishes to the mapped memory
+	bool isWriterAlive() const{
+		return header != 0 && header->writerAlive.load(std::memory_order_acquire) != 0;
+	}
+
+	void close(){
+		header = 0;
+		if(mapped != 0){
+			munmap(mapped, mapSize);
+			mapped = 0;
+		}
+		if(fd >= 0){
+			::close(fd);
+			fd = -1;
+		}
+	}
+
+	bool isOpen() const{
+		return header != 0;
+	}
+};
+
+#endif
@@ -0,0 +1,188 @@
+#ifndef TASK_GRAPH_H
+#define TASK_GRAPH_H
+
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include <deque>
+#include <mutex>
+
+#include "realtime.h"
+
+#define MAX_TASK_WORKERS 3 //Worker threads besides the caller, one per spare Pi core
+
+//Tasks with dependencies between them, run on a pool of worker threads.
+//Tasks are numbered in the order they are added, and may only depend on earlier Tasks
+class TaskGraph{
+private:
+	struct Task{
+		std::vector<int> dependents;
+		int dependencies = 0;
+	};
+	std::vector<Task> tasks;
+	bool parallel = false;
+
+	//Run state, guarded by mut
+	std::mutex mut;
+	std::condition_variable wake;
+	std::function<void(int)> work;
+	std::vector<int> waiting;
+	std::deque<int> ready;
+	int unfinished = 0;
+	bool stopping = false;
+	std::vector<std::thread> workers;
+
+public:
+	TaskGraph(){}
+	TaskGraph(const TaskGraph&) = delete;
+	TaskGraph &operator=(const TaskGraph&) = delete;
+	~TaskGraph(){
+		{
+			std::lock_guard<std::mutex> lock(mut);
+			stopping = true;
+		}
+		wake.notify_all();
+		for(std::thread &t : workers){
+			t.join();
+		}
+	}
+
+	//Remove every Task
+	void clear(){
+		tasks.clear();
+		parallel = false;
+	}
+
+	//Add a Task, returns its number
+	int addTask(){
+		tasks.push_back(Task());
+		return tasks.size() - 1;
+	}
+
+	//Task [after] waits for Task [before] to finish
+	void addDependency(int before, int after){
+		if(before == after || before < 0 || hasDependent(before, after)){
+			return;
+		}
+		tasks[before].dependents.push_back(after);
+		tasks[after].dependencies++;
+	}
+
+	bool hasDependents(int task){
+		return !tasks[task].dependents.empty();
+	}
+
+	bool hasDependent(int task, int dependent){
+		const std::vector<int> &d = tasks[task].dependents;
+		return std::find(d.begin(), d.end(), dependent) != d.end();
+	}
+
+	//Find whether any two Tasks can ever run at once, after the last Task is added
+	void finish(){
+		std::vector<int> remaining(tasks.size());
+		std::vector<int> available;
+		for(int i = 0; i < tasks.size(); i++){
+			remaining[i] = tasks[i].dependencies;
+			if(remaining[i] == 0){
+				available.push_back(i);
+			}
+		}
+		parallel = false;
+		while(!available.empty() && !parallel){
+			parallel = available.size() > 1;
+			int t = available.back();
+			available.pop_back();
+			for(int d : tasks[t].dependents){
+				if(--remaining[d] == 0){
+					available.push_back(d);
+				}
+			}
+		}
+	}
+
+	int getTaskCount(){
+		return tasks.size();
+	}
+	bool isParallel(){
+		return parallel;
+	}
+
+	//Run every Task with [f], returning once all have finished. The calling thread runs Tasks as well.
+	//A graph without independent Tasks runs in order on the calling thread
+	void run(std::function<void(int)> f){
+		if(!parallel){
+			for(int i = 0; i < tasks.size(); i++){
+				f(i);
+			}
+			return;
+		}
+		startWorkers();
+
+		std::unique_lock<std::mutex> lock(mut);
+		work = f;
+		waiting.resize(tasks.size());
+		for(int i = 0; i < tasks.size(); i++){
+			waiting[i] = tasks[i].dependencies;
+			if(waiting[i] == 0){
+				ready.push_back(i);
+			}
+		}
+		unfinished = tasks.size();
+		wake.notify_all();
+
+		while(unfinished > 0){
+			wake.wait(lock, [this]{ return unfinished == 0 || !ready.empty(); });
+			if(!ready.empty()){
+				runTask(lock);
+			}
+		}
+		work = nullptr;
+	}
+
+private:
+	void startWorkers(){
+		if(!workers.empty()){
+			return;
+		}
+		int count = std::max(1, std::min((int)std::thread::hardware_concurrency() - 1, MAX_TASK_WORKERS));
+		for(int i = 0; i < count; i++){
+			workers.push_back(std::thread(&TaskGraph::workerThread, this));
+		}
+	}
+
+	void workerThread(){
+		RealtimeThread realtime("worker");
+		std::unique_lock<std::mutex> lock(mut);
+		while(true){
+			wake.wait(lock, [this]{ return stopping || !ready.empty(); });
+			if(stopping){
+				return;
+			}
+			runTask(lock);
+		}
+	}
+
+	//Run the next ready Task without holding [lock], then release its dependents
+	void runTask(std::unique_lock<std::mutex> &lock){
+		int t = ready.front();
+		ready.pop_front();
+		lock.unlock();
+		work(t);
+		lock.lock();
+
+		bool released = false;
+		for(int d : tasks[t].dependents){
+			if(--waiting[d] == 0){
+				ready.push_back(d);
+				released = true;
+			}
+		}
+		if(--unfinished == 0 || released){
+			wake.notify_all();
+		}
+	}
+};
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef TERMINAL_H
 #define TERMINAL_H
 
+#include <unordered_map>
 #include <iostream>
 #include <fstream>
 
@@ -9,25 +10,40 @@
 
 class Terminal{
 private:
+	//Token matched by a Command Tree Node
+	enum NodeType{ NODE_WORD, NODE_INT, NODE_FLT, NODE_STR, NODE_STR_R };
+
 	struct CommandTreeNode{
 		std::string command;
+		NodeType type = NODE_WORD;
 		int flag = -1;
-		std::vector<CommandTreeNode> nextCommands;
+		std::vector<int> nextCommands;                  //All child nodes in file order
+		std::unordered_map<std::string, int> nextWords; //Child word nodes by word
+		std::vector<int> nextTyped;                     //Child INT, FLT, STR and STR_R nodes in file order
+		bool acceptsRemaining = false;                  //Has a STR_R child
 	};
 
+	//Flat Command Tree, the root is node 0
+	std::vector<CommandTreeNode> commandTree;
+
 	TerminalFunctions *functions;
-	CommandTreeNode command_root;
 	priorityMutex mut;
 
 public:
 	Terminal(std::string commandFile, TerminalFunctions *tf, priorityMutex m) {
 		functions = tf;
-		command_root = buildCommandTree(commandFile);
+		buildCommandTree(commandFile);
 		mut = m;
+
+		//Scripts are verified against this Terminal's Command Tree
+		functions->setCommandVerifier([this](const std::vector<std::string> &command, std::vector<int> *flags){
+			return verifyCommand(command, flags, true);
+		});
 	}
 
 	//Terminal Thread function
 	void terminalThread(bool *run){
+		RealtimeThread realtime("terminal");
 		std::vector<std::string> command;
 		std::string input = "";
 
@@ -35,20 +51,26 @@ public:
 
 		while(*run){
 			printf("Please enter a command: ");
-			std::getline(std::cin, input);
+			if(!std::getline(std::cin, input)){
+				//Input closed, stop reading
+				printf("\n");
+				break;
+			}
 			command = splitString(input, " ");
-			parseCommand(command, command_root);
+			parseCommand(command);
 		}
 	}
 
 	//Build Command Tree, used for command verification and flag-based functionality
-	CommandTreeNode buildCommandTree(std::string filename){
-		CommandTreeNode result;
+	void buildCommandTree(std::string filename){
+		commandTree.clear();
+		commandTree.push_back(CommandTreeNode());
+
 		std::fstream file;
 		file.open(filename, std::ios::in);
 		if(!file.is_open()){
 			printf("Error: Unable to open file\n");
-			return result;
+			return;
 		}
 		std::vector<std::vector<std::string>> readLines;
 		std::string line;
@@ -59,157 +81,208 @@ public:
 		}
 		file.close();
 
+		//Index lines by their starting label
+		std::unordered_map<std::string, std::vector<int>> labelLines;
+		for(int i = 0; i < readLines.size(); i++){
+			if(isCommandTreeLabel(readLines[i][0])){
+				labelLines[readLines[i][0]].push_back(i);
+			}
+		}
+
+		//Nodes reached through a label are built once and shared by every reference to it
+		std::unordered_map<std::string, std::vector<int>> labelNodes;
 		for(int i = 0; i < readLines.size(); i++){
 			if(!isCommandTreeLabel(readLines[i][0])){
-				result.nextCommands.push_back(buildCommandTreeNode(readLines, i, 0));
+				addNextCommand(0, buildCommandTreeNode(readLines, labelLines, labelNodes, i, 0));
 			}
 		}
 
-		printf("Command Tree successfully built\n");
-		return result;
+		printf("Command Tree successfully built (%d nodes)\n", (int)commandTree.size());
 	}
 
-	//Recursively add Command Tree Node
-	CommandTreeNode buildCommandTreeNode(std::vector<std::vector<std::string>> lines, int line_ind, int word_ind){
-		CommandTreeNode result;
+	//Recursively add Command Tree Node, returning its index
+	int buildCommandTreeNode(const std::vector<std::vector<std::string>> &lines,
+	                         const std::unordered_map<std::string, std::vector<int>> &labelLines,
+	                         std::unordered_map<std::string, std::vector<int>> &labelNodes,
+	                         int line_ind, int word_ind){
+		const std::vector<std::string> &line = lines[line_ind];
 		int offset = 1;
-		result.command = lines[line_ind][word_ind];
-		
+		int index = commandTree.size();
+		commandTree.push_back(CommandTreeNode());
+		commandTree[index].command = line[word_ind];
+		commandTree[index].type = getNodeType(line[word_ind]);
+
 		//If at the end of the command
-		if(word_ind == lines[line_ind].size() - offset){
-			return result;
+		if(word_ind == line.size() - offset){
+			return index;
 		}
-		else{
-			//If a flag is found
-			if(isCommandTreeFlag(lines[line_ind][word_ind + offset])){
-				result.flag = parseInteger(lines[line_ind][word_ind + offset++].substr(1));
-				if(word_ind == lines[line_ind].size() - offset){
-					return result;
-				}
-			}
-			//If a label is found
-			if(isCommandTreeLabel(lines[line_ind][word_ind + offset])){
-				std::vector<CommandTreeNode> nodes;
-				nodes = buildCommandTreeNodes(lines, lines[line_ind][word_ind + offset]);
-				for(CommandTreeNode ctn : nodes){
-					result.nextCommands.push_back(ctn);
-				}
+
+		//If a flag is found
+		if(isCommandTreeFlag(line[word_ind + offset])){
+			commandTree[index].flag = parseInteger(line[word_ind + offset++].substr(1));
+			if(word_ind == line.size() - offset){
+				return index;
 			}
-			//Otherwise
-			else{
-				result.nextCommands.push_back(buildCommandTreeNode(lines, line_ind, word_ind + offset));
+		}
+		//If a label is found
+		if(isCommandTreeLabel(line[word_ind + offset])){
+			std::vector<int> nodes = buildCommandTreeNodes(lines, labelLines, labelNodes, line[word_ind + offset]);
+			for(int n : nodes){
+				addNextCommand(index, n);
 			}
 		}
-		return result;
+		//Otherwise
+		else{
+			addNextCommand(index, buildCommandTreeNode(lines, labelLines, labelNodes, line_ind, word_ind + offset));
+		}
+		return index;
 	}
 
-	//Recursively add several Command Tree Nodes, used for parsing labels
-	std::vector<CommandTreeNode> buildCommandTreeNodes(std::vector<std::vector<std::string>> lines, std::string label){
-		std::vector<CommandTreeNode> result;
+	//Add the Command Tree Nodes a label leads to, built on first use
+	std::vector<int> buildCommandTreeNodes(const std::vector<std::vector<std::string>> &lines,
+	                                       const std::unordered_map<std::string, std::vector<int>> &labelLines,
+	                                       std::unordered_map<std::string, std::vector<int>> &labelNodes,
+	                                       const std::string &label){
+		std::unordered_map<std::string, std::vector<int>>::iterator built = labelNodes.find(label);
+		if(built != labelNodes.end()){
+			return built->second;
+		}
+
+		//Mark label as in progress, so a label leading back to itself ends here
+		labelNodes[label] = {};
+		std::vector<int> result;
+
+		std::unordered_map<std::string, std::vector<int>>::const_iterator found = labelLines.find(label);
+		if(found == labelLines.end()){
+			printf("Error: Command Tree label %s not found\n", label.c_str());
+			return result;
+		}
 
 		//For each line starting with the found label
-		for(int i = 0; i < lines.size(); i++){
-			if(lines[i][0] == label){
-				
-				//If the label leads to a regular command
-				if(!isCommandTreeLabel(lines[i][1])){
-					CommandTreeNode node;
-					node = buildCommandTreeNode(lines, i, 1);
-					result.push_back(node);
-				}
+		for(int i : found->second){
+			if(lines[i].size() < 2){
+				continue;
+			}
 
-				//If the label leads to another label
-				else{
-					std::vector<CommandTreeNode> nodes;
-					nodes = buildCommandTreeNodes(lines, lines[i][1]);
-					for(CommandTreeNode ctn : nodes){
-						result.push_back(ctn);
-					}
-				}
+			//If the label leads to a regular command
+			if(!isCommandTreeLabel(lines[i][1])){
+				result.push_back(buildCommandTreeNode(lines, labelLines, labelNodes, i, 1));
+			}
+
+			//If the label leads to another label
+			else{
+				std::vector<int> nodes = buildCommandTreeNodes(lines, labelLines, labelNodes, lines[i][1]);
+				result.insert(result.end(), nodes.begin(), nodes.end());
 			}
 		}
+
+		labelNodes[label] = result;
 		return result;
 	}
 
-	//Run through the Command Tree with a command
-	void parseCommand(std::vector<std::string> command, CommandTreeNode ctn){
+	//Link a child node to its parent
+	void addNextCommand(int parent, int child){
+		CommandTreeNode &p = commandTree[parent];
+		const CommandTreeNode &c = commandTree[child];
+		p.nextCommands.push_back(child);
+		if(c.type == NODE_WORD){
+			//Earlier words take precedence, as they did when searched in order
+			p.nextWords.insert(std::make_pair(c.command, child));
+		}
+		else{
+			p.nextTyped.push_back(child);
+			p.acceptsRemaining = p.acceptsRemaining || c.type == NODE_STR_R;
+		}
+	}
+
+	//Run through the Command Tree with a command, processing it if valid
+	void parseCommand(const std::vector<std::string> &command){
 		std::vector<int> flags;
-		bool invalid = false;
-		for(std::string word : command){
+		if(verifyCommand(command, &flags, true)){
+			highPriorityLock(mut);
+			functions->processFlags(command, flags);
+			highPriorityUnlock(mut);
+		}
+	}
+
+	//Run through the Command Tree with a command, collecting its flags. Returns whether it is valid
+	bool verifyCommand(const std::vector<std::string> &command, std::vector<int> *flags, bool verbose){
+		int ctn = 0;
+		for(const std::string &word : command){
 
 			//If no node is found, command is invalid
-			if(!getNextNode(word, &ctn)){
-				displayInvalidMessage("Command not recognized: " + word);
-				invalid = true;
-				break;
+			ctn = getNextNode(word, ctn);
+			if(ctn < 0){
+				if(verbose){
+					displayInvalidMessage("Command not recognized: " + word);
+				}
+				return false;
 			}
-			if(ctn.flag >= 0 && !containsFlag(flags, ctn.flag)){
-				flags.push_back(ctn.flag);
+			int flag = commandTree[ctn].flag;
+			if(flag >= 0 && !containsFlag(*flags, flag)){
+				flags->push_back(flag);
 			}
 		}
 
-		//Special case for STR_R, a recursive node that allows an arbitrary number of strings
-		if(ctn.nextCommands.size() != 0 && !invalid){
-			bool STR_R_found = false;
-			for(CommandTreeNode c : ctn.nextCommands){
-				STR_R_found = (STR_R_found || c.command == "STR_R");
-			}
-			if(!STR_R_found){
+		//STR_R is a recursive node that allows an arbitrary number of strings, so it may end the command
+		const CommandTreeNode &last = commandTree[ctn];
+		if(last.nextCommands.size() != 0 && !last.acceptsRemaining){
+			if(verbose){
 				displayInvalidMessage("Too few arguments");
 				printf("Expected: ");
-				for(CommandTreeNode c : ctn.nextCommands){
-					printf("%s ", c.command.c_str());
+				for(int c : last.nextCommands){
+					printf("%s ", commandTree[c].command.c_str());
 				}
 				printf("\n");
-				invalid = true;
 			}
+			return false;
 		}
-
-		//If command is valid, process
-		if(!invalid){
-			highPriorityLock(mut);
-			functions->processFlags(command, flags);
-			highPriorityUnlock(mut);
-		}
+		return true;
 	}
 
-	//Get the next Command Tree Node based on the command
-	bool getNextNode(std::string word, CommandTreeNode *ctn){
+	//Get the index of the next Command Tree Node based on the command, -1 if invalid
+	int getNextNode(const std::string &word, int ctn){
+		const CommandTreeNode &node = commandTree[ctn];
 
-		//If there are no remaining nodes, command is invalid
-		if(ctn->nextCommands.size() == 0){ return false; }
-		for(CommandTreeNode c : ctn->nextCommands){
+		//Words are matched by lookup
+		std::unordered_map<std::string, int>::const_iterator found = node.nextWords.find(word);
+		if(found != node.nextWords.end()){
+			return found->second;
+		}
 
-			//Handle INT, FLT, STR and STR_R nodes
-			if(c.command == "INT" || c.command == "FLT" || c.command == "STR" || c.command == "STR_R"){
-				if(c.command == "INT" && canParseInteger(word)){
-					*ctn = c;
-					return true;
-				}
-				if(c.command == "FLT" && canParseFloat(word)){
-					*ctn = c;
-					return true;
-				}	
-				if(c.command == "STR"){
-					*ctn = c;
-					return true;
-				}
-				if(c.command == "STR_R"){
-					return true;
-				}
-			}
-			else if(c.command == word){
-				*ctn = c;
-				return true;
+		//Handle INT, FLT, STR and STR_R nodes
+		for(int c : node.nextTyped){
+			switch(commandTree[c].type){
+				case NODE_INT:
+					if(canParseInteger(word)){ return c; }
+					break;
+				case NODE_FLT:
+					if(canParseFloat(word)){ return c; }
+					break;
+				case NODE_STR:
+					return c;
+				case NODE_STR_R:
+					return ctn;
+				default:
+					break;
 			}
 		}
 
 		//If command doesn't point to a new node, command is invalid
-		return false;
+		return -1;
+	}
+
+	//Returns the matcher type of a Command Tree word
+	NodeType getNodeType(const std::string &word){
+		if(word == "INT"){ return NODE_INT; }
+		if(word == "FLT"){ return NODE_FLT; }
+		if(word == "STR"){ return NODE_STR; }
+		if(word == "STR_R"){ return NODE_STR_R; }
+		return NODE_WORD;
 	}
 
 	//Returns whether a specific flag has been inserted
-	bool containsFlag(std::vector<int> flags, int query){
+	bool containsFlag(const std::vector<int> &flags, int query){
 		for(int f : flags){
 			if(f == query){
 				return true;
@@ -219,33 +292,34 @@ public:
 	}
 
 	//Returns whether a string is in the format of a label ( [LABEL] )
-	bool isCommandTreeLabel(std::string word){
-		return word[0] == '[' && word[word.length()-1] == ']';
+	bool isCommandTreeLabel(const std::string &word){
+		return word.length() > 0 && word[0] == '[' && word[word.length()-1] == ']';
 	}
 
 	//Returns whether a string is in the format of a flag ( /# )
-	bool isCommandTreeFlag(std::string word){
-		return word[0] == '/' && canParseInteger(word.substr(1));
+	bool isCommandTreeFlag(const std::string &word){
+		return word.length() > 1 && word[0] == '/' && canParseInteger(word.substr(1));
 	}
 
 	//Recursively prints the Command Tree
-	void printCommandTree(CommandTreeNode ctn, int length=0, bool first=true){
-		std::string label = ctn.command;
+	void printCommandTree(int ctn=0, int length=0, bool first=true){
+		const CommandTreeNode &node = commandTree[ctn];
+		std::string label = node.command;
 		if(label.length() > 0){
 			for(int i = 0; i < (first ? 1 : length); i++){
 				printf("-");
 			}
 		}
-		if(ctn.flag >= 0){
-			label += "(" + std::to_string(ctn.flag) + ")";
+		if(node.flag >= 0){
+			label += "(" + std::to_string(node.flag) + ")";
 		}
-		if(ctn.nextCommands.size() == 0){
+		if(node.nextCommands.size() == 0){
 			label += "\n";
 		}
 		printf("%s", label.c_str());
 
-		for(int i = 0; i < ctn.nextCommands.size(); i++){
-			printCommandTree(ctn.nextCommands[i], length+label.length()+1, i == 0);
+		for(int i = 0; i < node.nextCommands.size(); i++){
+			printCommandTree(node.nextCommands[i], length+label.length()+1, i == 0);
 		}
 	}
 };
@@ -3,139 +3,619 @@
 
 #include <string>
 #include <fstream>
+#include <map>
+#include <unordered_set>
 
+#include "instructionPlan.h"
+#include "textField.h"
+#include "quality.h"
+#include "taskGraph.h"
+#include "realtime.h"
+#include "latency.h"
+#include "script.h"
 #include "layer.h"
 
+#define MAX_SCRIPT_DEPTH 8
+#define TEXT_STATS_INTERVAL 0.5 //Seconds between updates of the fps, frametime and latency text variables
+
 class TerminalFunctions{
 private:
-	struct Instruction{
-		std::vector<std::string> command;
-		std::vector<int> flags;
-	};
 	std::vector<Instruction> instructionList;
+	InstructionPlan plan;
 	Canvas *canvas;
+
+	//Layers of the current frame, indexed by the plan's interned Layer name
+	std::vector<Layer> layerSlots;
+	std::vector<char> layerDefined; //Not vector<bool>, Layers are set from several threads
+
+	//Independent chains of ops, run in parallel, with the ops of every Task in order
+	TaskGraph tasks;
+	std::vector<std::vector<int>> taskOps;
+
+	//Time taken by every frame
+	Histogram frameTimes;
+
+	//Text of every text op, redrawn only where it changes, and the variables filled into it
+	std::vector<TextField> textFields;
+	TextVariables textVariables;
+	Timestamp statsStart;
+	int statsFrames = 0;
+	double statsMs = 0;
+	time_t shownClock = 0;
+
+	//Holds the frame rate by lowering quality. Mask ops keep the alpha they made, for frames they aren't run
+	QualityController quality;
+	struct CachedMask{
+		cv::Mat alpha;
+		cv::Point origin;
+		cv::Size fullSize;
+	};
+	std::vector<CachedMask> maskCache;
+	long int frameNumber = 0;
+	float cameraScale = 1;
+
+	//Visible region of the Layer each op creates, indexed by op
+	std::vector<cv::Rect> layerRegions;
+	std::vector<cv::Size> resizeTargets; //Final size of a resize of an image read from a smaller mip level, by op
 	bool *run;
 
+	//Scripts, with the scenes their timed steps load compiled ahead of time
+	CommandVerifier verifier;
+	Script script;
+	std::map<std::string, InstructionPlan> preparedPlans;
+	int scriptDepth = 0;
+
 public:
 	TerminalFunctions(Canvas *c, bool *r){
 		canvas = c;
 		run = r;
 
 		loadInstructions("default");
+		planChanged();
 	}
 
-	//Process Instructions in the Instruction List
-	void processInstructions(){
-		std::vector<Layer> layers;
+	//Rebuild everything derived from the compiled Instruction List
+	void planChanged(){
+		textFields.assign(plan.getOps().size(), TextField());
+		maskCache.assign(plan.getOps().size(), CachedMask());
+		buildTasks();
+		negotiateCamera();
+	}
 
-		for(Instruction inst : instructionList){
-			
-			//New Layer
-			if(containsFlag(inst, 20)){
-				layers.push_back(processInstructions_getLayer(inst));
+	//Split the compiled Instruction List into Tasks that can run at once. An op joins the last Task
+	//on its Layer unless another Task reads that Task's result, and waits for the Task of any other
+	//Layer it reads. Camera reads and draws keep their order, and Layers are not changed while read
+	void buildTasks(){
+		const std::vector<PlanOp> &ops = plan.getOps();
+		tasks.clear();
+		taskOps.clear();
+		std::vector<int> writer(plan.getStringCount(), -1);
+		std::vector<std::vector<int>> readers(plan.getStringCount());
+		int lastCamera = -1, lastDraw = -1;
+
+		for(int n = 0; n < ops.size(); n++){
+			const PlanOp &op = ops[n];
+
+			//Tasks that must finish first
+			std::vector<int> after = readers[op.layer];
+			if(op.type == OP_OVERLAY){
+				after.push_back(writer[op.source]);
+			}
+			if(op.type == OP_LAYER_CAMERA){
+				after.push_back(lastCamera);
+			}
+			if(op.type == OP_DRAW){
+				after.push_back(lastDraw);
 			}
 
-			//Process Layer
-			else if(containsFlag(inst, 21)){
-				for(int i = 0; i < layers.size(); i++){
-					if(layers[i].getName() == inst.command[1]){
-						processInstructions_processLayer(inst, &layers, i);
-						break;
-					}
-				}
+			//Continue the Layer's Task if nothing depends on it yet and every other wait is on an earlier Task
+			int task = writer[op.layer];
+			bool extend = task >= 0 && !tasks.hasDependents(task);
+			for(int t : after){
+				extend = extend && t < task;
+			}
+			if(!extend){
+				int previous = task;
+				task = tasks.addTask();
+				taskOps.push_back(std::vector<int>());
+				tasks.addDependency(previous, task);
 			}
+			for(int t : after){
+				tasks.addDependency(t, task);
+			}
+			taskOps[task].push_back(n);
 
-			//Draw Layer
-			else if(containsFlag(inst, 22)){
-				for(int i = 0; i < layers.size(); i++){
-					if(layers[i].getName() == inst.command[1]){
-						canvas->draw(layers[i]);
-						break;
-					}
+			//Track what the op reads and writes
+			readers[op.layer].clear();
+			if(op.type == OP_OVERLAY && op.source != op.layer){
+				readers[op.source].push_back(task);
+			}
+			lastCamera = op.type == OP_LAYER_CAMERA ? task : lastCamera;
+			lastDraw = op.type == OP_DRAW ? task : lastDraw;
+			writer[op.layer] = task;
+
+			//A fused camera resize runs as part of the camera op
+			if(isFusedCameraResize(n)){
+				n++;
+			}
+		}
+		tasks.finish();
+	}
+
+	//Negotiate the camera mode from the final size of every camera Layer in the Instruction List
+	void negotiateCamera(){
+		negotiateCamera(canvas->getCameraFPS());
+	}
+
+	void negotiateCamera(int fps){
+		cv::Size target(0, 0);
+		bool cameraUsed = false;
+		const std::vector<PlanOp> &ops = plan.getOps();
+
+		for(int n = 0; n < ops.size(); n++){
+			if(ops[n].type == OP_LAYER_CAMERA){
+				cv::Size size = canvas->getCameraNominalSize();
+				if(isFusedCameraResize(n)){
+					size = getCameraResizeTarget(ops[n + 1]);
 				}
+				target.width = std::max(target.width, size.width);
+				target.height = std::max(target.height, size.height);
+				cameraUsed = true;
 			}
 		}
+
+		//Without a camera Layer, capture as little as possible. Adaptive quality may capture less than needed
+		if(!cameraUsed){
+			target = cv::Size(1, 1);
+		}
+		else if(cameraScale < 1){
+			target = cv::Size(cvRound(target.width * cameraScale), cvRound(target.height * cameraScale));
+		}
+		canvas->negotiateCamera(target, fps);
 	}
 
-	//Process New Layer Instruction
-	Layer processInstructions_getLayer(Instruction inst){
-		Layer result;
-		
-		for(int f : inst.flags){
-			switch(f){
-				//Camera
-				case 201:
-					result = canvas->getCameraFrame();
+	//Validate the Instruction List from the changed index on, -1 if nothing changed
+	void instructionsChanged(int index){
+		if(index >= 0){
+			refactorInstructions(index);
+			instructionsChanged();
+		}
+	}
+
+	//Compile the Instruction List after every change, and follow it with the camera
+	void instructionsChanged(){
+		plan.compile(instructionList);
+		planChanged();
+	}
+
+	//Process Instructions in the compiled Instruction List
+	void processInstructions(){
+		Timestamp start = getMonotonicTime();
+		runScheduledCommands();
+
+		layerSlots.resize(plan.getStringCount());
+		layerDefined.assign(plan.getStringCount(), false);
+		findRegions();
+
+		tasks.run([this](int task){
+			for(int n : taskOps[task]){
+				processInstructions_processOp(n);
+			}
+		});
+		Timestamp end = getMonotonicTime();
+		frameTimes.record(getMilliseconds(start, end));
+		updateTextVariables(end, getMilliseconds(start, end));
+		if(quality.record(getMilliseconds(start, end))){
+			applyQuality();
+		}
+		frameNumber++;
+	}
+
+	//Apply the quality knobs that aren't read every frame
+	void applyQuality(){
+		canvas->getDisplay("monitor")->setInterval(quality.getMonitorInterval());
+		if(quality.getCameraScale() != cameraScale){
+			cameraScale = quality.getCameraScale();
+			negotiateCamera();
+		}
+	}
+
+	//Use the alpha a mask op made on an earlier frame, if masks aren't updated this frame. Returns false if op [n] must run
+	bool reuseMask(int n, Layer *layer){
+		CachedMask &cached = maskCache[n];
+		int interval = quality.getMaskInterval();
+		if(interval == 1){
+			cached.alpha.release();
+			return false;
+		}
+		if(frameNumber % interval == 0 || cached.alpha.size() != cv::Size(layer->getWidth(), layer->getHeight()) ||
+		   cached.origin != layer->getOrigin() || cached.fullSize != layer->getFullSize()){
+			return false;
+		}
+		layer->setAlphaChannel(cached.alpha);
+		return true;
+	}
+
+	//Keep the alpha mask op [n] made, while masks aren't updated every frame
+	void keepMask(int n, Layer *layer){
+		if(quality.getMaskInterval() > 1){
+			maskCache[n].alpha = layer->getAlphaChannel();
+			maskCache[n].origin = layer->getOrigin();
+			maskCache[n].fullSize = layer->getFullSize();
+		}
+	}
+
+	//Set a text variable to the rest of the command
+	void setTextVariable(Instruction inst){
+		std::string value = inst.command[2];
+		for(int i = 3; i < inst.command.size(); i++){
+			value += " " + inst.command[i];
+		}
+		textVariables.set(inst.command[1], value);
+	}
+
+	//Refresh the built in text variables, the clock every second and the rest every TEXT_STATS_INTERVAL seconds
+	void updateTextVariables(Timestamp now, double frameMs){
+		time_t clock = time(0);
+		if(clock != shownClock){
+			char formatted[16];
+			strftime(formatted, sizeof(formatted), "%H:%M:%S", localtime(&clock));
+			textVariables.set("clock", formatted);
+			shownClock = clock;
+		}
+
+		statsFrames++;
+		statsMs += frameMs;
+		double elapsed = getMilliseconds(statsStart, now);
+		if(elapsed < TEXT_STATS_INTERVAL * 1000){
+			return;
+		}
+		if(statsStart != Timestamp()){
+			textVariables.set("fps", statsFrames * 1000 / elapsed);
+			textVariables.set("frametime", statsMs / statsFrames);
+			textVariables.set("latency", canvas->getLatencyMonitor()->getRecent());
+		}
+		statsStart = now;
+		statsFrames = 0;
+		statsMs = 0;
+	}
+
+	//Process a single op of the compiled Instruction List
+	void processInstructions_processOp(int n){
+		const std::vector<PlanOp> &ops = plan.getOps();
+		const PlanOp &op = ops[n];
+
+		switch(op.type){
+			//New Layer, only its visible region is captured, and a Layer never seen is skipped, leaving its name
+			//undefined so later ops don't use an earlier Layer of the same name.
+			//A camera Layer resized by the next Instruction is captured at the final size
+			case OP_LAYER_CAMERA:
+				if(layerRegions[n].area() == 0){
+					layerDefined[op.layer] = false;
 					break;
-				//Image
-				case 202:
-					result = (canvas->getImageFrame(inst.command[3])).copy();
+				}
+				if(isFusedCameraResize(n)){
+					layerSlots[op.layer] = canvas->getCameraFrame(getCameraResizeTarget(ops[n + 1]), layerRegions[n]);
+				}
+				else{
+					layerSlots[op.layer] = canvas->getCameraFrame(cv::Size(), layerRegions[n]);
+				}
+				layerDefined[op.layer] = true;
+				break;
+			case OP_LAYER_IMAGE:
+				if(layerRegions[n].area() == 0){
+					layerDefined[op.layer] = false;
 					break;
-				default:
+				}
+				layerSlots[op.layer] = canvas->getImageFrame(plan.getString(op.source), isImageResize(n) ? resizeTargets[n + 1] : cv::Size())
+				                       .getRegion(layerRegions[n]).share();
+				layerDefined[op.layer] = true;
+				break;
+			//Frames from another process, only their visible region is copied
+			case OP_LAYER_SHARED:
+				if(layerRegions[n].area() == 0){
+					layerDefined[op.layer] = false;
 					break;
-			}
+				}
+				layerSlots[op.layer] = canvas->getSharedFrame(plan.getString(op.source), layerRegions[n]);
+				layerDefined[op.layer] = true;
+				break;
+
+			//Draw Layer
+			case OP_DRAW:
+				if(layerDefined[op.layer]){
+					canvas->draw(layerSlots[op.layer]);
+				}
+				break;
+
+			//Process Layer, a resize of an image read from a smaller mip level is by the size of the full image
+			default:
+				if(!layerDefined[op.layer]){
+					break;
+				}
+				if(resizeTargets[n].area() > 0){
+					layerSlots[op.layer].resizeLayer(resizeTargets[n].width, resizeTargets[n].height, quality.getFilter((ResampleFilter)op.mode));
+				}
+				else{
+					processInstructions_processLayer(n, &layerSlots[op.layer]);
+				}
+				break;
 		}
-			
-		result.setName(inst.command[1]);
-		return result;
 	}
 
-	//Process Process Layer Instruction
-	void processInstructions_processLayer(Instruction inst, std::vector<Layer> *layers, int index){
-		std::string input = "";
-		for(int f : inst.flags){
-			switch(f){
-				//Resize
-				case 30:
-					//Resize dimensions
-					if(containsFlag(inst, 300)){
-						(*layers)[index].resizeLayer(parseInteger(inst.command[4]), parseInteger(inst.command[5]));
+	//Find the part of every new Layer that reaches the composite, walking back from each draw.
+	//Resizes and overlays map the visible part back to their source, a rotation needs the whole Layer
+	void findRegions(){
+		const std::vector<PlanOp> &ops = plan.getOps();
+		layerRegions.assign(ops.size(), cv::Rect());
+		resizeTargets.assign(ops.size(), cv::Size());
+
+		//Size of the Layer before and after every op, and of the top Layer of every overlay
+		std::vector<cv::Size> sizes(plan.getStringCount()), before(ops.size()), after(ops.size()), topSizes(ops.size());
+		std::vector<bool> fused(ops.size(), false);
+		for(int n = 0; n < ops.size(); n++){
+			const PlanOp &op = ops[n];
+			before[n] = sizes[op.layer];
+			cv::Size &size = sizes[op.layer];
+			switch(op.type){
+				case OP_LAYER_CAMERA:
+					size = canvas->getCameraNominalSize();
+					if(isFusedCameraResize(n)){
+						size = getCameraResizeTarget(ops[n + 1]);
+						fused[n + 1] = true;
 					}
-					//Resize scale
-					else{
-						(*layers)[index].resizeLayer(parseFloat(inst.command[4]));
+					break;
+				//An image resized by the next op is read from the smallest mip level at least the final size
+				case OP_LAYER_IMAGE:
+					size = canvas->getImageSize(plan.getString(op.source));
+					if(isImageResize(n)){
+						const PlanOp &resize = ops[n + 1];
+						resizeTargets[n + 1] = resize.type == OP_RESIZE_DIMENSIONS ? cv::Size(resize.ints[0], resize.ints[1]) :
+						                       cv::Size(cvRound(size.width * resize.value), cvRound(size.height * resize.value));
+						size = canvas->getImageSize(plan.getString(op.source), resizeTargets[n + 1]);
 					}
 					break;
-				//Rotate
-				case 31:
-					(*layers)[index].rotateLayer(parseInteger(inst.command[3]));
+				case OP_LAYER_SHARED:
+					size = canvas->getSharedFrameSize(plan.getString(op.source));
 					break;
-				//Alpha
-				case 32:
-					//Alpha flat
-					if(containsFlag(inst, 320)){
-						(*layers)[index].setAlpha(parseFloat(inst.command[4]));
-					}
-					//Alpha circular
-					else{
-						(*layers)[index].setAlphaPattern_Circular(parseInteger(inst.command[4]), parseInteger(inst.command[5]));
+				case OP_RESIZE_DIMENSIONS:
+					size = fused[n] ? size : cv::Size(op.ints[0], op.ints[1]);
+					break;
+				case OP_RESIZE_SCALE:
+					size = fused[n] ? size : resizeTargets[n].area() > 0 ? resizeTargets[n] :
+					       cv::Size(cvRound(size.width * op.value), cvRound(size.height * op.value));
+					break;
+				case OP_ROTATE:
+					size = getRotatedSize(size, normalizeAngle(op.value), op.mode == 1);
+					break;
+				case OP_OVERLAY:
+					topSizes[n] = sizes[op.source];
+					break;
+				default:
+					break;
+			}
+			after[n] = size;
+		}
+
+		//Visible part of every Layer, from the last op back
+		std::vector<cv::Rect> need(plan.getStringCount());
+		cv::Size composite = canvas->getCompositeSize();
+		for(int n = ops.size() - 1; n >= 0; n--){
+			const PlanOp &op = ops[n];
+			cv::Rect &visible = need[op.layer];
+			cv::Size size = before[n];
+			cv::Rect bounds(0, 0, size.width, size.height);
+			switch(op.type){
+				//Drawn centered on the composite
+				case OP_DRAW: {
+					cv::Point offset((composite.width - size.width) / 2, (composite.height - size.height) / 2);
+					visible |= (cv::Rect(cv::Point(), composite) - offset) & bounds;
+					break;
+				}
+				//Top Layer is seen where it lies over the visible part of the bottom Layer
+				case OP_OVERLAY: {
+					cv::Size top = topSizes[n];
+					cv::Point offset((size.width - top.width) / 2, (size.height - top.height) / 2);
+					cv::Rect seen = (visible - offset) & cv::Rect(0, 0, top.width, top.height);
+					if(seen.area() > 0){
+						need[op.source] |= seen;
 					}
 					break;
-				//Text
-				case 33:
-					for(int i = 3; i < inst.command.size(); i++){
-						input += inst.command[i];
-						if(i != inst.command.size() - 1){
-							input += " ";
-						}
+				}
+				//Scale back to the source, with a margin for the filter
+				case OP_RESIZE_DIMENSIONS:
+				case OP_RESIZE_SCALE: {
+					if(fused[n] || visible.area() == 0 || after[n].area() == 0){
+						break;
 					}
-					(*layers)[index].overlayText(input, canvas->getText());
-					break;
-				//Overlay
-				case 34:
-					for(int i = 0; i < layers->size(); i++){
-						if((*layers)[i].getName() == inst.command[3]){
-							(*layers)[index].overlay((*layers)[i]);
-							break;
-						}
+					double sx = (double)size.width / after[n].width, sy = (double)size.height / after[n].height;
+					int mx = (int)std::ceil(getFilterSupport((ResampleFilter)op.mode) * std::max(1.0, sx)) + 1;
+					int my = (int)std::ceil(getFilterSupport((ResampleFilter)op.mode) * std::max(1.0, sy)) + 1;
+					cv::Point start((int)std::floor(visible.x * sx) - mx, (int)std::floor(visible.y * sy) - my);
+					cv::Point end((int)std::ceil(visible.br().x * sx) + mx, (int)std::ceil(visible.br().y * sy) + my);
+					visible = cv::Rect(start, end) & bounds;
+					break;
+				}
+				case OP_ROTATE:
+					if(visible.area() > 0){
+						visible = bounds;
 					}
 					break;
+				//New Layer, nothing before this op is seen under its name
+				case OP_LAYER_CAMERA:
+				case OP_LAYER_IMAGE:
+				case OP_LAYER_SHARED:
+					layerRegions[n] = visible & cv::Rect(cv::Point(), after[n]);
+					visible = cv::Rect();
+					break;
 				default:
 					break;
 			}
 		}
 	}
 
+	//Returns whether op [index] is a camera Layer immediately resized by the next op, without filtering
+	bool isFusedCameraResize(int index){
+		const std::vector<PlanOp> &ops = plan.getOps();
+		if(index + 1 >= ops.size()){
+			return false;
+		}
+		const PlanOp &next = ops[index + 1];
+		return ops[index].type == OP_LAYER_CAMERA && next.layer == ops[index].layer &&
+		       (next.type == OP_RESIZE_DIMENSIONS || next.type == OP_RESIZE_SCALE) && next.mode == FILTER_NEAREST;
+	}
+
+	//Returns whether op [index] is an image Layer immediately resized by the next op
+	bool isImageResize(int index){
+		const std::vector<PlanOp> &ops = plan.getOps();
+		if(index + 1 >= ops.size()){
+			return false;
+		}
+		const PlanOp &next = ops[index + 1];
+		return ops[index].type == OP_LAYER_IMAGE && next.layer == ops[index].layer &&
+		       (next.type == OP_RESIZE_DIMENSIONS || next.type == OP_RESIZE_SCALE);
+	}
+
+	//Size a camera frame is captured at for a fused resize op
+	cv::Size getCameraResizeTarget(const PlanOp &resize){
+		if(resize.type == OP_RESIZE_DIMENSIONS){
+			return cv::Size(resize.ints[0], resize.ints[1]);
+		}
+		return canvas->getCameraScaledSize(resize.value);
+	}
+
+	//Process Process Layer Instruction
+	void processInstructions_processLayer(int n, Layer *layer){
+		const PlanOp &op = plan.getOps()[n];
+		switch(op.type){
+			//Resize dimensions
+			case OP_RESIZE_DIMENSIONS:
+				layer->resizeLayer(op.ints[0], op.ints[1], quality.getFilter((ResampleFilter)op.mode));
+				break;
+			//Resize scale
+			case OP_RESIZE_SCALE:
+				layer->resizeLayer(op.value, quality.getFilter((ResampleFilter)op.mode));
+				break;
+			//Rotate
+			case OP_ROTATE:
+				layer->rotateLayer(op.value, op.mode == 1);
+				break;
+			//Alpha flat
+			case OP_ALPHA_FLAT:
+				layer->setAlpha(op.value);
+				break;
+			//Alpha circular
+			case OP_ALPHA_CIRCULAR:
+				if(!reuseMask(n, layer)){
+					layer->setAlphaPattern_Circular(op.ints[0], op.ints[1]);
+					keepMask(n, layer);
+				}
+				break;
+			//Text, with variables filled in
+			case OP_TEXT:
+				layer->overlay(textFields[n].update(plan.getString(op.source), textVariables, canvas->getText()));
+				break;
+			//Overlay
+			case OP_OVERLAY:
+				if(layerDefined[op.source]){
+					layer->overlay(layerSlots[op.source]);
+				}
+				break;
+			//Chroma key
+			case OP_KEY_CHROMA:
+				if(!reuseMask(n, layer)){
+					layer->applyKey(*getKeyTable(KEY_CHROMA, op.ints[0], op.ints[1], op.value));
+					keepMask(n, layer);
+				}
+				break;
+			//Luma key
+			case OP_KEY_LUMA:
+				if(!reuseMask(n, layer)){
+					layer->applyKey(*getKeyTable(KEY_LUMA, op.ints[0], op.ints[1]));
+					keepMask(n, layer);
+				}
+				break;
+			//Color LUT
+			case OP_LUT: {
+				std::shared_ptr<const ColorLut> lut = getColorLut(plan.getString(op.source));
+				if(lut){
+					layer->applyLut(*lut);
+				}
+				break;
+			}
+			default:
+				break;
+		}
+	}
+
+
+	//Set the function used to verify script commands against the Command Tree
+	void setCommandVerifier(CommandVerifier v){
+		verifier = v;
+	}
+
+	//Run a script: immediate commands now, timed commands from the frame loop. Every line is verified before
+	//any runs, and the immediate commands run as one batch under the lock held for the run command
+	void runScript(std::string filename){
+		if(!verifier){
+			printf("Error: Scripts are unavailable without a terminal\n");
+			return;
+		}
+		if(scriptDepth >= MAX_SCRIPT_DEPTH){
+			printf("Error: Scripts nested too deeply, not running %s\n", filename.c_str());
+			return;
+		}
+		Script loaded;
+		if(!loaded.load(filename, verifier)){
+			return;
+		}
+
+		scriptDepth++;
+		for(const Script::Step &step : loaded.getImmediateSteps()){
+			processFlags(step.inst.command, step.inst.flags);
+		}
+		scriptDepth--;
+
+		if(!loaded.getTimedSteps().empty()){
+			script = loaded;
+			prepareScriptScenes();
+			script.startAt(getMonotonicTime());
+		}
+	}
+
+	//Compile every scene loaded by the running script's timed steps ahead of their deadlines
+	void prepareScriptScenes(){
+		preparedPlans.clear();
+		for(const Script::Step &step : script.getTimedSteps()){
+			Instruction inst = step.inst;
+			if(!containsFlag(inst, 3) || preparedPlans.count(inst.command[1]) != 0){
+				continue;
+			}
+			std::string name = inst.command[1];
+			InstructionPlan prepared;
+			std::vector<Instruction> instructions;
+			if(prepared.load("./InstructionLists/" + name + ".inlb") ||
+			   (loadInstructionsText(name, &instructions) && prepared.compile(instructions))){
+				preparedPlans[name] = prepared;
+			}
+		}
+		printf("Prepared %d scenes for script %s\n", (int)preparedPlans.size(), script.getName().c_str());
+	}
+
+	//Run timed script commands due at the start of this frame
+	void runScheduledCommands(){
+		if(!script.isRunning()){
+			return;
+		}
+		std::vector<Instruction> due = script.getDue(getMonotonicTime());
+		for(Instruction &inst : due){
+			processFlags(inst.command, inst.flags);
+		}
+		if(!due.empty() && !script.isRunning()){
+			printf("Script %s finished\n", script.getName().c_str());
+			preparedPlans.clear();
+		}
+	}
 
 	//Process Flags from input command
 	void processFlags(std::vector<std::string> command, std::vector<int> flags){
@@ -150,9 +630,11 @@ public:
 					break;
 				case 2: //Clear
 					clearInstructions();
+					planChanged();
 					break;
 				case 3: //Load
 					loadInstructions(inst);
+					planChanged();
 					break;
 				case 4: //Save
 					saveInstructions(inst);
@@ -163,17 +645,54 @@ public:
 				case 6: //Print information
 					printInfo(inst);
 					break;
+				case 7: //Camera settings
+					setCameraSettings(inst);
+					break;
+				case 9: //Convert instruction list file
+					convertInstructions(inst);
+					break;
+				case 8: //Timewarp
+					setTimewarp(inst);
+					break;
+				case 14://Latency measurement
+					setLatencySettings(inst);
+					break;
+				case 15://Run script
+					if(containsFlag(inst, 151)){
+						script.stop();
+						preparedPlans.clear();
+						printf("Script stopped\n");
+					}
+					else{
+						runScript(inst.command[1]);
+					}
+					break;
+				case 16://Real-time scheduling
+					setRealtimeSettings(inst);
+					break;
+				case 17://Shared memory export
+					canvas->setExport(containsFlag(inst, 171) ? "" : inst.command[1]);
+					break;
+				case 18://Recording
+					canvas->setRecording(containsFlag(inst, 181) ? inst.command[2] : "");
+					break;
+				case 19://Image cache
+					canvas->getImageManager().setBudget(parseInteger(inst.command[2]));
+					break;
+				case 23://Text variable
+					setTextVariable(inst);
+					break;
+				case 24://Adaptive quality
+					setQualitySettings(inst);
+					break;
 				case 10://Push new Instruction
-					pushInstruction(inst);
-					refactorInstructions();
+					instructionsChanged(pushInstruction(inst));
 					break;
 				case 12://Edit Instruction
-					editInstruction(inst);
-					refactorInstructions();
+					instructionsChanged(editInstruction(inst));
 					break;
 				case 13://Delete Instruction
-					deleteInstruction(inst);
-					refactorInstructions();
+					instructionsChanged(deleteInstruction(inst));
 					break;
 				default:
 					break;
@@ -184,31 +703,45 @@ public:
 	//Clear instruction list
 	void clearInstructions(){
 		instructionList = { };
+		plan.clear();
+		layerSlots.clear();
 		canvas->clear();
 	}
 
-	//Save current instruction list to file
+	//Save current instruction list to file, in text or binary format
 	void saveInstructions(Instruction inst){
+		if(containsFlag(inst, 41)){
+			std::string filename = "./InstructionLists/" + inst.command[2] + ".inlb";
+			if(plan.save(filename)){
+				printf("Instruction List saved to file: %s\n", filename.c_str());
+			}
+		}
+		else{
+			saveInstructionsText(instructionList, inst.command[1]);
+		}
+	}
+
+	void saveInstructionsText(const std::vector<Instruction> &instructions, std::string name){
 		std::ofstream saveFile;
-		saveFile.open("./InstructionLists/" + inst.command[1] + ".inli");
-		for(int i = 0; i < instructionList.size(); i++){
-			for(int c = 0; c < instructionList[i].command.size(); c++){
-				saveFile << instructionList[i].command[c];
-				if(c != instructionList[i].command.size() - 1){
+		saveFile.open("./InstructionLists/" + name + ".inli");
+		for(int i = 0; i < instructions.size(); i++){
+			for(int c = 0; c < instructions[i].command.size(); c++){
+				saveFile << instructions[i].command[c];
+				if(c != instructions[i].command.size() - 1){
 					saveFile << " ";
 				}
 			}
 			saveFile << '\n';
-			for(int f = 0; f < instructionList[i].flags.size(); f++){
-				saveFile << instructionList[i].flags[f];
-				if(f != instructionList[i].flags.size() - 1){
+			for(int f = 0; f < instructions[i].flags.size(); f++){
+				saveFile << instructions[i].flags[f];
+				if(f != instructions[i].flags.size() - 1){
 					saveFile << " ";
 				}
 			}
 			saveFile << '\n';
 		}
 		saveFile.close();
-		printf("Instruction List saved to file: ./InstructionLists/%s.inli\n", inst.command[1].c_str());
+		printf("Instruction List saved to file: ./InstructionLists/%s.inli\n", name.c_str());
 	}
 
 	//Load instruction list from file
@@ -216,50 +749,248 @@ public:
 		loadInstructions(inst.command[1]);
 	}
 
+	//Load a scene prepared by a script, [filename].inlb if it exists, otherwise [filename].inli
 	void loadInstructions(std::string filename){
+		//Prepared scenes are swapped in without blanking the screen
+		std::map<std::string, InstructionPlan>::iterator prepared = preparedPlans.find(filename);
+		if(prepared != preparedPlans.end()){
+			plan = prepared->second;
+			instructionList = plan.toInstructions();
+			planChanged();
+			printf("Instruction List loaded from prepared scene: %s\n", filename.c_str());
+			return;
+		}
+
+		InstructionPlan loaded;
+		if(loaded.load("./InstructionLists/" + filename + ".inlb")){
+			clearInstructions();
+			plan = loaded;
+			instructionList = plan.toInstructions();
+			printf("Instruction List loaded from file: ./InstructionLists/%s.inlb\n", filename.c_str());
+			return;
+		}
+
+		std::vector<Instruction> instructions;
+		if(loadInstructionsText(filename, &instructions)){
+			clearInstructions();
+			instructionList = instructions;
+			plan.compile(instructionList);
+			printf("Instruction List loaded from file: ./InstructionLists/%s.inli\n", filename.c_str());
+		}
+	}
+
+	//Read a text instruction list, returns false if it can't be opened
+	bool loadInstructionsText(std::string filename, std::vector<Instruction> *instructions){
 		std::ifstream loadFile;
 		loadFile.open("./InstructionLists/" + filename + ".inli");
 		if(!loadFile.is_open()){
 			printf("Unable to load ./InstructionLists/%s.inli\n", filename.c_str());
+			return false;
 		}
-		else{
-			clearInstructions();
-			std::vector<std::string> readFlags;
-			std::string input;
-			while(getline(loadFile, input)){
-				Instruction inst;
-				inst.command = splitString(input, " ");
-				getline(loadFile, input);
-				readFlags = splitString(input, " ");
-				for(std::string f : readFlags){
-					if(f != ""){
-						inst.flags.push_back(std::stoi(f));
-					}
+		std::vector<std::string> readFlags;
+		std::string input;
+		while(getline(loadFile, input)){
+			Instruction inst;
+			inst.command = splitString(input, " ");
+			getline(loadFile, input);
+			readFlags = splitString(input, " ");
+			for(std::string f : readFlags){
+				if(canParseInteger(f)){
+					inst.flags.push_back(parseInteger(f));
+				}
+				else if(f != ""){
+					printf("Error: Invalid flag %s in ./InstructionLists/%s.inli\n", f.c_str(), filename.c_str());
 				}
-				instructionList.push_back(inst);
 			}
-			printf("Instruction List loaded from file: ./InstructionList/%s.inli\n", filename.c_str());
+			instructions->push_back(inst);
 		}
 		loadFile.close();
+		return true;
+	}
+
+	//Convert an instruction list file between text and binary formats
+	void convertInstructions(Instruction inst){
+		std::string name = inst.command[2];
+		InstructionPlan converted;
+
+		//Text to binary
+		if(containsFlag(inst, 91)){
+			std::vector<Instruction> instructions;
+			if(loadInstructionsText(name, &instructions) && converted.compile(instructions) &&
+			   converted.save("./InstructionLists/" + name + ".inlb")){
+				printf("Converted ./InstructionLists/%s.inli to ./InstructionLists/%s.inlb\n", name.c_str(), name.c_str());
+			}
+		}
+		//Binary to text
+		else{
+			if(converted.load("./InstructionLists/" + name + ".inlb")){
+				saveInstructionsText(converted.toInstructions(), name);
+			}
+			else{
+				printf("Unable to load ./InstructionLists/%s.inlb\n", name.c_str());
+			}
+		}
 	}
 
-	//Change which displays video is output to
+	//Change Display settings
 	void setDisplayOutput(Instruction inst){
+		//List Displays
+		if(containsFlag(inst, 55)){
+			canvas->printDisplays();
+			return;
+		}
+
+		Display *display = canvas->getDisplay(inst.command[1]);
+		if(display == 0){
+			displayInvalidMessage("Display not found: " + inst.command[1]);
+			return;
+		}
 
-		//Parse boolean
-		bool output = containsFlag(inst, 53);
+		//Presentation rate
+		if(containsFlag(inst, 56)){
+			display->setRate(parseFloat(inst.command[3]));
+		}
+		//Scale
+		else if(containsFlag(inst, 57)){
+			float scale = parseFloat(inst.command[3]);
+			if(scale <= 0){
+				displayInvalidMessage("Scale must be positive");
+				return;
+			}
+			display->setScale(scale);
+		}
+		//Crop
+		else if(containsFlag(inst, 58)){
+			cv::Rect crop(parseInteger(inst.command[3]), parseInteger(inst.command[4]),
+			              parseInteger(inst.command[5]), parseInteger(inst.command[6]));
+			//A crop outside the composite would leave nothing to show
+			if(crop.area() > 0 && (crop & cv::Rect(cv::Point(), canvas->getCompositeSize())).area() == 0){
+				displayInvalidMessage("Crop must overlap the composite");
+				return;
+			}
+			display->setCrop(crop);
+		}
+		//Scaling filter
+		else if(containsFlag(inst, 59)){
+			display->setFilter(InstructionPlan::getFilter(inst, FILTER_NEAREST));
+		}
+		//Enable or disable
+		else{
+			canvas->setDisplayEnabled(inst.command[1], containsFlag(inst, 53));
+		}
+	}
+
+	//Change camera capture settings
+	void setCameraSettings(Instruction inst){
+		//Capture format
+		if(containsFlag(inst, 71)){
+			canvas->setCameraRawCapture(containsFlag(inst, 711));
+		}
+		//Information
+		else if(containsFlag(inst, 72)){
+			canvas->printCameraInfo();
+		}
+		//Frame rate
+		else if(containsFlag(inst, 73)){
+			negotiateCamera(parseInteger(inst.command[2]));
+		}
+	}
 
-		//Parse display output
-		if(containsFlag(inst, 51)){
-			canvas->setMonitorOutput(output);
+	//Change asynchronous presentation and reprojection settings
+	void setTimewarp(Instruction inst){
+		//Orientation replay
+		if(containsFlag(inst, 81)){
+			canvas->setOrientationReplay(inst.command[2]);
 		}
+		//Display rate
+		else if(containsFlag(inst, 82)){
+			canvas->setTimewarpRate(parseInteger(inst.command[2]));
+		}
+		//Enable or disable
 		else{
-			canvas->setViveOutput(output);
+			canvas->setTimewarp(containsFlag(inst, 53));
 		}
 	}
 
-	//Push new Instruction to the Instruction List
-	void pushInstruction(Instruction inst){
+	//Change adaptive quality settings
+	void setQualitySettings(Instruction inst){
+		if(containsFlag(inst, 241)){
+			quality.setTarget(parseFloat(inst.command[2]));
+		}
+		else if(containsFlag(inst, 242)){
+			quality.setLimit(inst.command[2], parseInteger(inst.command[3]));
+		}
+		else if(containsFlag(inst, 243)){
+			quality.setThermal(inst.command[2], parseInteger(inst.command[3]));
+		}
+		else{
+			quality.setEnabled(containsFlag(inst, 53));
+		}
+		applyQuality();
+	}
+
+	//Change latency measurement settings
+	void setLatencySettings(Instruction inst){
+		LatencyMonitor *latency = canvas->getLatencyMonitor();
+		//Stop logging
+		if(containsFlag(inst, 142)){
+			latency->setLogFile("");
+		}
+		//Log to file
+		else if(containsFlag(inst, 141)){
+			latency->setLogFile(inst.command[2]);
+		}
+		//Reset histograms
+		else if(containsFlag(inst, 143)){
+			latency->reset();
+			frameTimes.reset();
+			printf("Latency and frame time measurements reset\n");
+		}
+	}
+
+	//Change thread scheduling and memory locking
+	void setRealtimeSettings(Instruction inst){
+		RealtimeConfig &config = getRealtimeConfig();
+		//List settings
+		if(containsFlag(inst, 161)){
+			config.print();
+		}
+		//Load settings file
+		else if(containsFlag(inst, 162)){
+			loadRealtimeConfig(inst.command[2]);
+		}
+		//Lock memory
+		else if(containsFlag(inst, 163)){
+			if(config.setMemoryLock(containsFlag(inst, 53))){
+				printf("Memory %s\n", config.isMemoryLocked() ? "locked" : "unlocked");
+				canvas->prefault();
+			}
+		}
+		//Cores
+		else if(containsFlag(inst, 164)){
+			if(config.setCPUs(inst.command[1], inst.command[3])){
+				printf("%s threads pinned to cores %s\n", inst.command[1].c_str(), inst.command[3].c_str());
+			}
+		}
+		//Priority
+		else if(containsFlag(inst, 165)){
+			if(config.setPriority(inst.command[1], parseInteger(inst.command[3]))){
+				printf("%s threads set to priority %s\n", inst.command[1].c_str(), inst.command[3].c_str());
+			}
+		}
+	}
+
+	//Load real-time settings from [filename], touching output memory if it is locked
+	void loadRealtimeConfig(std::string filename){
+		RealtimeConfig &config = getRealtimeConfig();
+		config.load(filename);
+		if(config.isMemoryLocked()){
+			canvas->prefault();
+		}
+	}
+
+	//Push new Instruction to the Instruction List, returns its index or -1
+	int pushInstruction(Instruction inst){
 		int pushIndex = -1;
 		bool indexGiven = containsFlag(inst, 11);
 		if(indexGiven){
@@ -272,31 +1003,31 @@ public:
 			std::vector<std::string> newCommand(inst.command.begin() + (indexGiven ? 2 : 1), inst.command.end());
 			inst.command = newCommand;
 			instructionList.insert(instructionList.begin() + pushIndex, inst);
+			return pushIndex;
 		}
-		else{
-			displayInvalidMessage("Index out of range");
-		}
+		displayInvalidMessage("Index out of range");
+		return -1;
 	}
 
-	//Delete Instruction from the Instruction List
-	void deleteInstruction(Instruction inst){
+	//Delete Instruction from the Instruction List, returns its index or -1
+	int deleteInstruction(Instruction inst){
 		int delIndex = -1;
 		if(canParseInteger(inst.command[1])){
 			delIndex = parseInteger(inst.command[1]);
 			if(0 <= delIndex && delIndex < instructionList.size()){
 				instructionList.erase(instructionList.begin() + delIndex);
+				return delIndex;
 			}
-			else{
-				displayInvalidMessage("Index out of range");
-			}
+			displayInvalidMessage("Index out of range");
 		}
 		else{
 			displayInvalidMessage("Invalid index");
 		}
+		return -1;
 	}
 
-	//Edit Instruction in the Instruction List
-	void editInstruction(Instruction inst){
+	//Edit Instruction in the Instruction List, returns its index or -1
+	int editInstruction(Instruction inst){
 		int editIndex = -1;
 		if(canParseInteger(inst.command[1])){
 			editIndex = parseInteger(inst.command[1]);
@@ -304,68 +1035,60 @@ public:
 				std::vector<std::string> newCommand(inst.command.begin() + 2, inst.command.end());
 				inst.command = newCommand;
 				instructionList.at(editIndex) = inst;
+				return editIndex;
 			}
-			else{
-				displayInvalidMessage("Index out of range");
-			}
+			displayInvalidMessage("Index out of range");
 		}
 		else{
 			displayInvalidMessage("Invalid index");
 		}
+		return -1;
 	}
 
-	//Remove any invalid Instructions, which point to a Layer or image file that doesn't exist
-	void refactorInstructions(){
+	//Remove any invalid Instructions from [start] on, which point to a Layer, image or LUT file that doesn't exist.
+	//Instructions before [start] are unchanged, so they only contribute their Layer names
+	void refactorInstructions(int start=0){
+		std::unordered_set<std::string> defined;
 		for(int i = 0; i < instructionList.size(); i++){
+			const Instruction &inst = instructionList[i];
+			bool valid = true;
 
-			//Layer flag
-			if(containsFlag(instructionList[i], 20)){ 
+			if(i >= start){
+				//Layer flag
+				if(containsFlag(inst, 20)){
+					//Image flag
+					valid = !containsFlag(inst, 202) || doesImageExist(inst);
+				}
 
-				//Image flag
-				if(containsFlag(instructionList[i], 202)){
-					if(!(doesImageExist(instructionList[i]))){
-						instructionList.erase(instructionList.begin() + i--);
-						printf("Irrelevant instruction found, erasing\n");
-					}
+				//Process flag
+				else if(containsFlag(inst, 21)){
+					valid = defined.count(inst.command[1]) != 0 &&
+					        (!containsFlag(inst, 34) || defined.count(inst.command[3]) != 0) &&
+					        (!containsFlag(inst, 35) || getColorLut(inst.command[3]) != nullptr);
 				}
-			}
 
-			//Process flag
-			else if(containsFlag(instructionList[i], 21)){
-				if((!isInstructionValid(instructionList[i], i)) ||
-				   (!isInstructionValid(instructionList[i], i, 3) && containsFlag(instructionList[i], 34))){
-					instructionList.erase(instructionList.begin() + i--);
-					printf("Irrelevant instruction found, erasing\n");
+				//Draw flag
+				else if(containsFlag(inst, 22)){
+					valid = defined.count(inst.command[1]) != 0;
 				}
-			}
 
-			//Draw flag
-			else if(containsFlag(instructionList[i], 22)){
-				if(!isInstructionValid(instructionList[i], i)){
-					instructionList.erase(instructionList.begin() + i--);
-					printf("Irrelevant instruction found, erasing\n");
+				else{
+					printf("Error: Unrecognized instruction: %s\n", inst.command[0].c_str());
 				}
 			}
 
-			else{
-				printf("Error: Unrecognized instruction: %s\n", instructionList[i].command[0].c_str());
+			if(!valid){
+				instructionList.erase(instructionList.begin() + i--);
+				printf("Irrelevant instruction found, erasing\n");
 			}
-		}
-	}
-
-	//Returns whether Instruction points to valid Layer in Instruction List
-	bool isInstructionValid(Instruction inst, int listInd, int commandInd=1){
-		std::string layerName = inst.command[commandInd];
-		for(int i = 0; i < listInd; i++){
-			if(containsFlag(instructionList[i], 20) && instructionList[i].command[1] == layerName){
-				return true;
+			else if(containsFlag(inst, 20)){
+				defined.insert(inst.command[1]);
 			}
 		}
-		return false;
 	}
 
 	//Returns whether Instruction contains a certain flag
-	bool containsFlag(Instruction inst, int query){
+	bool containsFlag(const Instruction &inst, int query){
 		for(int f : inst.flags){
 			if(f == query){
 				return true;
@@ -375,7 +1098,7 @@ public:
 	}
 
 	//Returns whether an image file has been loaded
-	bool doesImageExist(Instruction inst){
+	bool doesImageExist(const Instruction &inst){
 		return canvas->getImageManager().doesImageExist(inst.command[inst.command.size()-1]);
 	}
 
@@ -405,6 +1128,21 @@ public:
 		if(containsFlag(inst, 61)){
 			printInstructions();
 		}
+		else if(containsFlag(inst, 62)){
+			canvas->getLatencyMonitor()->print();
+		}
+		else if(containsFlag(inst, 63)){
+			frameTimes.print("FRAME TIME");
+		}
+		else if(containsFlag(inst, 64)){
+			canvas->getImageManager().print();
+		}
+		else if(containsFlag(inst, 65)){
+			textVariables.print();
+		}
+		else if(containsFlag(inst, 66)){
+			quality.print();
+		}
 	}
 
 	void printInstruction(Instruction inst){
@@ -429,11 +1167,22 @@ public:
 		       "*************************************************************\n"
 		       "* help -> Display this message                              *\n"
 		       "* print instructions -> Print the current instruction list  *\n"
+		       "* print latency -> Print the camera to display latency      *\n"
+		       "*                  histogram                                *\n"
+		       "* print frames -> Print the frame time histogram            *\n"
+		       "* print images -> Print the image cache and the mip levels  *\n"
+		       "*                  held in memory                           *\n"
+		       "* print variables -> Print every text variable              *\n"
+		       "* print quality -> Print adaptive quality knobs             *\n"
 		       "* clear -> Delete all instructions in the instruction list  *\n"
 		       "* save [NAME] -> Save the current instruction list in       *\n"
 		       "*                file [NAME].inli                           *\n"
+		       "* save binary [NAME] -> Save the current instruction list   *\n"
+		       "*                       in binary file [NAME].inlb          *\n"
 		       "* load [NAME] -> Load an instruction list from file         *\n"
-		       "*                [NAME].inli                                *\n"
+		       "*                [NAME].inlb, or [NAME].inli                *\n"
+		       "* convert [binary | text] [NAME] -> Convert file [NAME]     *\n"
+		       "*                                   to the given format     *\n"
 		       "* push [INSTRUCTION] -> Add a new instruction at the end of *\n"
 		       "*                       the list                            *\n"
 		       "* push [#] [INSTRUCTION] -> Push a new instruction directly *\n"
@@ -441,24 +1190,102 @@ public:
 		       "* edit [#] [INSTRUCTION] -> Edit Instruction [#]            *\n"
 		       "* delete [#] -> Delete Instruction [#]                      *\n"
 		       "*                                                           *\n"
-		       "* display [vive | monitor] [true | false] -> set the video  *\n"
-		       "*                                            output         *\n"
+		       "* display [NAME] [true | false] -> Enable or disable the    *\n"
+		       "*                                  display [NAME], such as  *\n"
+		       "*                                  vive or monitor          *\n"
+		       "* display [NAME] rate [FLT] -> Present [NAME] at [FLT] fps, *\n"
+		       "*                              or every frame as it is      *\n"
+		       "*                              finished if 0                *\n"
+		       "* display [NAME] scale [FLT] -> Scale the output of [NAME]  *\n"
+		       "* display [NAME] crop [X] [Y] [W] [H] -> Show only part of  *\n"
+		       "*                                        the frame, or all  *\n"
+		       "*                                        of it if W is 0    *\n"
+		       "* display [NAME] filter [FILTER] -> Scale [NAME] with       *\n"
+		       "*                                   nearest, box, bilinear  *\n"
+		       "*                                   or lanczos filtering    *\n"
+		       "* display list -> Print every display and its settings      *\n"
+		       "* camera format [yuv | bgr] -> Capture raw YUV frames, or   *\n"
+		       "*                             frames converted to BGR       *\n"
+		       "* camera info -> Print camera properties                    *\n"
+		       "* camera fps [INT] -> Set the camera frame rate             *\n"
+		       "* timewarp [true | false] -> Present the Vive on its own    *\n"
+		       "*                            thread, reprojecting frames    *\n"
+		       "*                            when processing runs late      *\n"
+		       "* timewarp replay [FILE] -> Replay head orientation from    *\n"
+		       "*                           [FILE] for reprojection         *\n"
+		       "* timewarp rate [INT] -> Set the Vive display rate          *\n"
+		       "* latency log [FILE | off] -> Log every latency measurement *\n"
+		       "*                             to [FILE], or stop logging    *\n"
+		       "* latency reset -> Clear latency and frame time             *\n"
+		       "*                  measurements                             *\n"
+		       "* run [FILE] -> Run the terminal commands in [FILE]. Lines  *\n"
+		       "*               starting with \"at [TIME]\" run [TIME]        *\n"
+		       "*               seconds after the script starts             *\n"
+		       "* run stop -> Cancel the timed commands of a script         *\n"
+		       "* export [NAME] -> Publish every frame to shared memory     *\n"
+		       "*                 /[NAME] for other programs to read        *\n"
+		       "* export off -> Stop publishing frames                      *\n"
+		       "* record start [FILE] -> Record every frame to [FILE] on    *\n"
+		       "*                        its own thread, dropping frames    *\n"
+		       "*                        if the disk falls behind           *\n"
+		       "* record stop -> Stop recording                             *\n"
+		       "* images budget [INT] -> Keep at most [INT] MB of images    *\n"
+		       "*                         and mip levels in memory          *\n"
+		       "* set [NAME] [STR] -> Set text variable {[NAME]} to [STR]   *\n"
+		       "* quality [true | false] -> Lower quality when frames run   *\n"
+		       "*                           late, and raise it again        *\n"
+		       "* quality target [FLT] -> Set the frame rate held           *\n"
+		       "* quality limit [KNOB] [INT] -> Lower monitor, mask,        *\n"
+		       "*                               filter or camera at most    *\n"
+		       "*                               [INT] levels, 0 to 2        *\n"
+		       "* quality thermal [FILE] [INT] -> Read the temperature      *\n"
+		       "*                                 from [FILE], lowering     *\n"
+		       "*                                 quality at [INT] C        *\n"
+		       "* realtime list -> Print thread scheduling settings         *\n"
+		       "* realtime load [FILE] -> Load real-time settings from      *\n"
+		       "*                         [FILE]                            *\n"
+		       "* realtime lock [true | false] -> Lock all memory, so no    *\n"
+		       "*                                 page faults stall frames  *\n"
+		       "* realtime [ROLE] cpus [LIST] -> Pin render, terminal,      *\n"
+		       "*                                presenter, worker or       *\n"
+		       "*                                recorder threads to cores, *\n"
+		       "*                                such as 2,3 or all         *\n"
+		       "* realtime [ROLE] fifo [INT] -> Run [ROLE] threads with     *\n"
+		       "*                               SCHED_FIFO priority [INT],  *\n"
+		       "*                               or normally if 0            *\n"
 		       "* exit -> Exit the program                                  *\n"
 		       "*************************************************************\n"
 		       "* INSTRUCTIONS                                              *\n"
 		       "*************************************************************\n"
 		       "* layer [NAME] camera -> Grab the most recent camera frame  *\n"
 		       "* layer [NAME] image [FILE] -> Load a .PNG file             *\n"
+		       "* layer [NAME] shm [NAME] -> Use the newest frame another   *\n"
+		       "*                            program published to shared    *\n"
+		       "*                            memory /[NAME]                 *\n"
 		       "*                                                           *\n"
 		       "* process [NAME] resize [ dimensions [INT] [INT] | scale    *\n"
 		       "*				[FLT] ] -> Resize a layer   *\n"
+		       "* process [NAME] resize [FILTER] [ dimensions [INT] [INT] | *\n"
+		       "*               scale [FLT] ] -> Resize with [FILTER]:      *\n"
+		       "*               nearest, box, bilinear or lanczos           *\n"
 		       "* process [NAME] rotate [FLT] -> Rotate a layer to an angle *\n"
+		       "* process [NAME] rotate expand [FLT] -> Rotate a layer,     *\n"
+		       "*                                       growing it to fit   *\n"
 		       "* process [NAME] alpha [ flat [INT] | circular [INT]        *\n"
 		       "*               [INT] ] -> Set a flat alpha, or a circular  *\n"
 		       "*               patterned alpha (inner, outer)              *\n"
-		       "* process [NAME] text [STR] -> Print text on a layer        *\n"
+		       "* process [NAME] text [STR] -> Print text on a layer, with  *\n"
+		       "*                              variables such as {fps},     *\n"
+		       "*                              {frametime}, {latency} and   *\n"
+		       "*                              {clock} filled in            *\n"
 		       "* process [NAME] overlay [NAME] -> Overlay a layer onto     *\n"
 		       "*                                    another layer          *\n"
+		       "* process [NAME] lut [STR] -> Color grade a layer with a    *\n"
+		       "*               .cube file from the Luts folder             *\n"
+		       "* process [NAME] key [ chroma [INT] [INT] [FLT] | luma      *\n"
+		       "*               [INT] [INT] ] -> Make a hue transparent     *\n"
+		       "*               (hue, tolerance, softness in degrees), or   *\n"
+		       "*               dark colors (low, high luma)                *\n"
 		       "*                                                           *\n"
 		       "* draw [NAME] -> Draw a layer to the selected outputs       *\n"
 		       "*************************************************************\n");
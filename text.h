@@ -3,6 +3,7 @@
 
 #include <opencv2/core.hpp>
 #include <string>
+#include <vector>
 
 #include "layer.h"
 #include "helper.h"
@@ -50,44 +51,68 @@ public:
 		styling.maxCharWidth = 128;
 	}
 
-	//Return single line of text as an image
-	cv::Mat getLine(std::string text){
+	//Text color as BGRA, multiplied by alpha if [premultiplied]
+	cv::Vec4b getColor(bool premultiplied=false){
+		cv::Vec4b color(styling.blue, styling.green, styling.red, styling.alpha);
+		if(premultiplied){
+			for(int c = 0; c < 3; c++){
+				color[c] = (color[c] * styling.alpha + 127) / 255;
+			}
+		}
+		return color;
+	}
+
+	//Draw character [c] scaled to fill [cell] of a BGRA image, clearing the rest of the cell
+	void drawGlyph(cv::Mat &image, char c, cv::Rect cell, cv::Vec4b color){
+		bool known = c >= 32 && c < 32 + 94;
+		for(int y = 0; y < cell.height; y++){
+			cv::Vec4b *p = image.ptr<cv::Vec4b>(cell.y + y) + cell.x;
+			int glyphY = y * 8 / cell.height;
+			for(int x = 0; x < cell.width; x++){
+				p[x] = known && characters[c - 32][glyphY][x * 8 / cell.width] ? color : cv::Vec4b(0, 0, 0, 0);
+			}
+		}
+	}
+
+	//Return single line of text as an image, with color multiplied by alpha if [premultiplied]
+	cv::Mat getLine(std::string text, bool premultiplied=false){
+		cv::Vec4b color = getColor(premultiplied);
 		cv::Mat wordImage(8, 8 * text.length(), CV_8UC4);
 		for(int i = 0; i < text.length(); i++){
 			for(int y = 0; y < 8; y++){
 				for(int x = 0; x < 8; x++){
 					wordImage.at<cv::Vec4b>(y, x + i * 8) =
-						characters[text[i]-32][y][x] ?
-						cv::Vec4b(styling.blue, styling.green, styling.red, styling.alpha) :
-						cv::Vec4b(0, 0, 0, 0);
+						characters[text[i]-32][y][x] ? color : cv::Vec4b(0, 0, 0, 0);
 				}
 			}
 		}
 		return wordImage;
 	}
 
+	//Split text into the lines getText draws, as characters on its 8x8 grid
+	std::vector<std::string> layoutText(std::string text){
+		std::vector<std::string> words = splitWords(text);
+		std::vector<std::string> lines(1);
+		for(std::string word : words){
+			if(!lines.back().empty() && lines.back().length() + 1 + word.length() >= styling.maxCharWidth){
+				lines.push_back("");
+			}
+			lines.back() += (lines.back().empty() ? "" : " ") + word;
+		}
+		return lines;
+	}
+
 	//Return block of text as an image
-	cv::Mat getText(std::string text){
+	cv::Mat getText(std::string text, bool premultiplied=false){
 		int xDim = 0, yDim = 1, curr_x = 0, delimPos = 0;
 		std::vector<cv::Mat> wordList;
 		std::string delim = " ";
 
-		//Divide text into words no longer than the Maximum Character Width
-		std::vector<std::string> words = splitString(text, " ");
-		for(int i = 0; i < words.size(); i++){
-			if(words[i] == ""){
-				words[i] = " ";
-			}
-			while(words[i].length() > styling.maxCharWidth){
-				std::string longWord = words[i];
-				words[i] = longWord.substr(0, styling.maxCharWidth - 1);
-				words.insert(words.begin() + i++ + 1, longWord.substr(styling.maxCharWidth));
-			}
-		}
+		std::vector<std::string> words = splitWords(text);
 
 		//Push words as images into list
 		for(std::string word : words){
-			wordList.push_back(getLine(word));
+			wordList.push_back(getLine(word, premultiplied));
 
 			if(curr_x + word.length() >= styling.maxCharWidth){
 				yDim += 1;
@@ -117,6 +142,22 @@ public:
 		return textImage; 
 	}
 
+	//Divide text into words no longer than the Maximum Character Width
+	std::vector<std::string> splitWords(std::string text){
+		std::vector<std::string> words = splitString(text, " ");
+		for(int i = 0; i < words.size(); i++){
+			if(words[i] == ""){
+				words[i] = " ";
+			}
+			while(words[i].length() > styling.maxCharWidth){
+				std::string longWord = words[i];
+				words[i] = longWord.substr(0, styling.maxCharWidth - 1);
+				words.insert(words.begin() + i++ + 1, longWord.substr(styling.maxCharWidth));
+			}
+		}
+		return words;
+	}
+
 	//Styling functions
 	void setStyling(int r, int g, int b, int a, float s, int w){
 		styling.red = r;
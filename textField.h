@@ -0,0 +1,146 @@
+#ifndef TEXT_FIELD_H
+#define TEXT_FIELD_H
+
+#include <opencv2/core.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <map>
+
+#include "layer.h"
+#include "text.h"
+
+//Named values filled into text, such as {fps}. The version changes whenever a value does,
+//so text that hasn't changed is never expanded again
+class TextVariables{
+private:
+	std::map<std::string, std::string> values;
+	std::atomic<int> version;
+	std::mutex mut;
+
+public:
+	TextVariables(){
+		version = 0;
+	}
+
+	//Set variable [name] to [value]
+	void set(std::string name, std::string value){
+		std::lock_guard<std::mutex> lock(mut);
+		std::string &current = values[name];
+		if(current != value){
+			current = value;
+			version++;
+		}
+	}
+
+	//Set variable [name] to [value] with one decimal
+	void set(std::string name, double value){
+		char formatted[32];
+		snprintf(formatted, sizeof(formatted), "%.1f", value);
+		set(name, std::string(formatted));
+	}
+
+	int getVersion(){
+		return version;
+	}
+
+	//Replace every {name} in [text] with its value. Unknown names are left as they are
+	std::string expand(const std::string &text){
+		std::string result;
+		std::lock_guard<std::mutex> lock(mut);
+		size_t start = 0;
+		while(true){
+			size_t open = text.find('{', start), close = text.find('}', open);
+			if(open == std::string::npos || close == std::string::npos){
+				break;
+			}
+			std::map<std::string, std::string>::iterator v = values.find(text.substr(open + 1, close - open - 1));
+			result += text.substr(start, open - start);
+			result += v != values.end() ? v->second : text.substr(open, close - open + 1);
+			start = close + 1;
+		}
+		return result + text.substr(start);
+	}
+
+	void print(){
+		std::lock_guard<std::mutex> lock(mut);
+		for(std::map<std::string, std::string>::iterator v = values.begin(); v != values.end(); v++){
+			printf("  {%s} = %s\n", v->first.c_str(), v->second.c_str());
+		}
+	}
+};
+
+//Text drawn into a persistent premultiplied image, laid out as getText does. When the text changes
+//but its layout doesn't, only the glyph cells whose characters changed are drawn again
+class TextField{
+private:
+	std::string source;  //Text before variables are filled in
+	std::string shown;   //Text last drawn
+	int version = -1;
+	std::vector<std::string> lines;
+	int cell = 0;
+	cv::Vec4b color;
+	cv::Mat image;
+	Layer layer;
+
+public:
+	//Returns [text], with its variables filled in, as a premultiplied Layer
+	Layer update(const std::string &text, TextVariables &variables, Text &font){
+		int current = variables.getVersion();
+		if(!image.empty() && current == version && text == source){
+			return layer;
+		}
+		source = text;
+		version = current;
+		std::string expanded = variables.expand(text);
+		if(!image.empty() && expanded == shown){
+			return layer;
+		}
+		draw(expanded, font);
+		return layer;
+	}
+
+private:
+	void draw(const std::string &text, Text &font){
+		std::vector<std::string> newLines = font.layoutText(text);
+		int newCell = std::max(1, cvRound(8 * font.getStyling().fontSize));
+		cv::Vec4b newColor = font.getColor(true);
+
+		//Every line is followed by a space, as in getText
+		int columns = 0;
+		for(const std::string &line : newLines){
+			columns = std::max(columns, (int)line.length() + 1);
+		}
+		cv::Size size(columns * newCell, newLines.size() * newCell);
+
+		//Start again when the layout or styling changes
+		bool full = image.size() != size || newCell != cell || newColor != color;
+		if(full){
+			image = cv::Mat(size, CV_8UC4, cv::Scalar(0));
+			lines.assign(newLines.size(), "");
+			cell = newCell;
+			color = newColor;
+		}
+
+		for(int row = 0; row < newLines.size(); row++){
+			const std::string &before = lines[row], &after = newLines[row];
+			for(int column = 0; column < columns; column++){
+				char was = column < before.length() ? before[column] : ' ';
+				char now = column < after.length() ? after[column] : ' ';
+				if(was != now){
+					font.drawGlyph(image, now, cv::Rect(column * cell, row * cell, cell, cell), color);
+				}
+			}
+		}
+		lines = newLines;
+		shown = text;
+
+		layer = Layer::borrow(image, false, true);
+		layer.analyzeSpans();
+	}
+};
+
+#endif
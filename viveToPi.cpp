@@ -4,35 +4,109 @@
 #include "canvas.h"
 #include "terminal.h"
 #include "terminal_functions.h"
+#include "options.h"
+
+int main(int argc, char** argv){
+	LaunchOptions options;
+	if(!parseOptions(argc, argv, &options)){
+		return 1;
+	}
 
-int main(int, char**){
 	//Clear terminal
-	system("clear");
+	if(!options.headless){
+		system("clear");
+	}
 
 	std::mutex d, n, l;
 	priorityMutex mut {&d, &n, &l};
 
 	bool run = true;
+	bool interactive = options.frames < 0;
+
+	//Initialize outputs
+	Output *vive, *monitor;
+	if(options.headless){
+		std::string dir = options.headlessDir;
+		HeadlessOutput *hv = new HeadlessOutput(2160, 1200, dir == "" ? "" : dir + "/vive.raw");
+		HeadlessOutput *hm = new HeadlessOutput(1920, 1080, dir == "" ? "" : dir + "/monitor.raw");
+		hv->setPngOutput((dir == "" ? "." : dir) + "/vive", options.pngInterval);
+		hm->setPngOutput((dir == "" ? "." : dir) + "/monitor", options.pngInterval);
+		vive = hv;
+		monitor = hm;
+	}
+	else{
+		vive = new Framebuffer("/dev/fb1");
+		monitor = new Framebuffer("/dev/fb0");
+	}
 
 	//Initialize objects
-	Canvas canvas("/dev/fb1", "/dev/fb0", 0, "./Images/", "font2.png", true, true);
+	Canvas canvas(vive, monitor, options.cameraID, "./Images/", "font2.png", true, true);
+
+	//Additional outputs mirror the frame, scaled to fit
+	for(std::string name : options.outputs){
+		Output *output;
+		if(options.headless){
+			std::string dir = options.headlessDir;
+			HeadlessOutput *ho = new HeadlessOutput(1280, 720, dir == "" ? "" : dir + "/" + name + ".raw");
+			ho->setPngOutput((dir == "" ? "." : dir) + "/" + name, options.pngInterval);
+			output = ho;
+		}
+		else{
+			output = new Framebuffer(name.c_str());
+		}
+		if(!output->isOpen()){
+			delete output;
+			continue;
+		}
+		DisplaySettings settings;
+		settings.scale = std::min((float)output->getXRes() / COMPOSITE_XRES, (float)output->getYRes() / COMPOSITE_YRES);
+		canvas.addDisplay(name.substr(name.find_last_of('/') + 1), output, settings);
+	}
+
 	TerminalFunctions terminalFunctions(&canvas, &run);
 	Terminal terminal("./Terminal/instructions.term", &terminalFunctions, mut);
 
+	//Schedule this thread as the render thread, with any startup settings
+	RealtimeThread renderThread("render");
+	if(options.realtime != ""){
+		terminalFunctions.loadRealtimeConfig(options.realtime);
+	}
+
 	//Clear Vive framebuffer
 	canvas.clear();
 
+	//Run startup script
+	if(options.script != ""){
+		terminalFunctions.runScript(options.script);
+	}
+
 	//Start Terminal thread
-	std::thread th(&Terminal::terminalThread, terminal, &run);
+	std::thread th;
+	if(interactive){
+		th = std::thread(&Terminal::terminalThread, terminal, &run);
+	}
 
 	//Draw camera
+	long int frames = 0;
+	auto start = getTime();
 	while(run){
 		lowPriorityLock(mut);
 		terminalFunctions.processInstructions();
 		lowPriorityUnlock(mut);
+
+		if(++frames == options.frames){
+			run = false;
+		}
+	}
+	auto stop = getTime();
+
+	if(th.joinable()){
+		th.join();
 	}
 
-	th.join();
+	//Report throughput
+	std::chrono::duration<double> duration = stop - start;
+	printf("Rendered %ld frames in %f s (%f fps)\n", frames, duration.count(), frames / duration.count());
 
 	//Cleanup
 	printf("Closing ViveToPi...\n");